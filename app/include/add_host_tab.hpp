@@ -24,6 +24,7 @@ class AddHostTab : public brls::Box
     void stopSearchHost();
     void connectHost(const std::string& address);
     void fillSearchBox(const GSResult<std::vector<Host>>& hostsRes);
+    void showFoundHosts(const GSResult<std::vector<Host>>& result);
     static void pauseSearching();
     static void startSearching();
     brls::Event<GSResult<std::vector<Host>>>::Subscription searchSubscription;
@@ -9,12 +9,16 @@
 
 #include <borealis.hpp>
 #include "GameStreamClient.hpp"
+#include "grid_view.hpp"
 
 using namespace brls;
 
-class AppCell : public Box {
+class AppCell : public Box, public GridPrefetchable {
   public:
+    // An empty cell for a virtualized grid, filled in by bind
+    AppCell(const Host& host);
     AppCell(const Host& host, const AppInfo& app, int currentApp);
+    ~AppCell() override;
 
     BRLS_BIND(Image, image, "image");
     BRLS_BIND(Label, title, "title");
@@ -24,6 +28,30 @@ class AppCell : public Box {
 
     void setFavorite(bool favorite);
 
+    // Applies a rename or a change of the running app without reloading
+    // the box art
+    void update(const AppInfo& app, int currentApp);
+
+    // Shows another app in a recycled cell, dropping the old box art. The
+    // host is rebound too, the cell may outlive the copy it was made with.
+    void bind(const Host& host, const AppInfo& app, int currentApp);
+
+    void draw(NVGcontext* vg, float x, float y, float width, float height,
+              Style style, FrameContext* ctx) override;
+
+    // Box art is only requested once the grid says the cell is close to
+    // the screen
+    void setPrefetchPriority(int priority) override;
+
   private:
+    Host host;
+    AppInfo app{"", -1};
+    std::string boxArtHash;
+    uint64_t boxArtTicket = 0;
+    bool boxArtFailed = false;
+
+    void loadBoxArt(int priority);
+    void resetBoxArt();
+
     void updateFavoriteAction(Host host, AppInfo app);
 };
@@ -12,19 +12,25 @@
 #include "loading_overlay.hpp"
 #include <Settings.hpp>
 #include <borealis.hpp>
+#include "AppSearchIndex.hpp"
 #include "GameStreamClient.hpp"
 
+#include <map>
 #include <optional>
 
 using namespace brls;
 
-class AppListView : public Box {
+class AppListView : public Box, public GridDataSource {
   public:
     AppListView(const Host& host);
 
     void onLayout() override;
     void willAppear(bool resetState) override;
 
+    size_t numberOfItems() override { return visibleApps.size(); }
+    View* createItem() override;
+    void bindItem(View* view, size_t index) override;
+
   private:
     Host host;
     View* hintView = nullptr;
@@ -35,10 +41,19 @@ class AppListView : public Box {
     void blockInput(bool block);
 
     GridView* gridView;
+    AppInfoList apps;
+    int currentGame = 0;
+
+    // Search results as indices into apps, the grid binds through these
+    AppSearchIndex searchIndex;
+    std::vector<size_t> visibleApps;
+    std::string filter;
     BRLS_BIND(Box, container, "container");
 
     void setCurrentApp(const AppInfo& app);
     void terninateApp();
     void updateAppList();
+    void showApps(const AppInfoList& newApps, int currentGame);
+    void applyFilter();
     void updateFavoriteAction(AppCell* cell, Host host, const AppInfo& app);
 };
@@ -11,6 +11,26 @@
 
 using namespace brls;
 
+// Grid items that load something expensive. The grid tells them how urgent
+// that is: lower is sooner, -1 means scrolled so far away that a pending
+// load should be dropped.
+class GridPrefetchable {
+  public:
+    virtual ~GridPrefetchable() = default;
+    virtual void setPrefetchPriority(int priority) = 0;
+};
+
+// Feeds a virtualized GridView. The grid only creates views for the rows
+// near the screen and binds them to other items as they scroll by.
+class GridDataSource {
+  public:
+    virtual ~GridDataSource() = default;
+    virtual size_t numberOfItems() = 0;
+    // A new view for the grid to own and rebind from then on
+    virtual View* createItem() = 0;
+    virtual void bindItem(View* view, size_t index) = 0;
+};
+
 class GridView : public Box {
   public:
     GridView();
@@ -18,6 +38,11 @@ class GridView : public Box {
 
     void addView(View* view) override;
     void clearViews(bool free = true) override;
+    // Switches the grid to virtualized mode, where items come from the data
+    // source instead of addView. Call reloadData when the items change.
+    void setDataSource(GridDataSource* dataSource);
+    void reloadData();
+
     View* getParentNavigationDecision(View* from, View* newFocus,
                                       FocusDirection direction) override;
     std::vector<View*>& getChildren();
@@ -25,7 +50,25 @@ class GridView : public Box {
     int getRows();
     int getItemsInRow(int row);
 
+    void draw(NVGcontext* vg, float x, float y, float width, float height,
+              Style style, FrameContext* ctx) override;
+
   private:
+    void updatePrefetchPriorities();
+    void updateVirtualRows();
+    void resizeRowPool(size_t rows);
+    void bindRow(Box* row, size_t rowIndex);
+    void updateVirtualLayout();
+    size_t rowCapacity();
+
+    GridDataSource* dataSource = nullptr;
+    size_t itemCount = 0;
+    size_t firstRow = 0;
+
+    int prefetchFocus = -1;
+    float prefetchOffset = 0;
+    size_t prefetchCount = 0;
+
     int columls = 1;
     Box* lastContainer = nullptr;
     View* lastView = nullptr;
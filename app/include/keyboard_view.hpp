@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <bitset>
 #include <borealis.hpp>
 #include <map>
 
@@ -30,7 +31,7 @@ struct KeyboardLocale {
 };
 
 struct KeyboardState {
-    bool keys[_VK_KEY_MAX];
+    std::bitset<_VK_KEY_MAX> keys;
     KeyboardState() = default;
 };
 
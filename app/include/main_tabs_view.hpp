@@ -20,7 +20,7 @@ class MainTabs : public brls::TabFrame {
     static View* create();
 
     void willAppear(bool resetState) override;
-    FavoriteTab* getFavoriteTab() { return favoriteTab; }
+    FavoriteTab* getFavoriteTab();
     void updateFavoritesIfNeeded();
 
     static MainTabs* getInstanse() { return instanse; }
@@ -29,5 +29,5 @@ class MainTabs : public brls::TabFrame {
     bool lastHasAnyFavorites = false;
     inline static MainTabs* instanse;
 
-    FavoriteTab* favoriteTab;
+    FavoriteTab* favoriteTab = nullptr;
 };
@@ -48,6 +48,7 @@ class SettingsTab : public brls::Box {
     BRLS_BIND(brls::Header, mouseSpeedHeader, "mouse_speed_header");
     BRLS_BIND(brls::Slider, mouseSpeedSlider, "mouse_speed_slider");
     BRLS_BIND(brls::BooleanCell, writeLog, "writeLog");
+    BRLS_BIND(brls::SelectorCell, boxartMemory, "boxart_memory");
 
     static brls::View* create();
 
@@ -12,6 +12,7 @@
 #include "loading_overlay.hpp"
 #include <Settings.hpp>
 #include <borealis.hpp>
+#include <chrono>
 #include <optional>
 #include "GameStreamClient.hpp"
 #include "MoonlightSession.hpp"
@@ -50,6 +51,8 @@ class StreamingView : public brls::Box {
     int touchScrollCounter = 0;
     size_t bottombarDelayTask = -1;
     bool m_use_hdr = false;
+    std::string statistics;
+    std::chrono::steady_clock::time_point statsUpdated;
     TwoFingerScrollGestureRecognizer* scrollTouchRecognizer = nullptr;
 
     void handleInput();
@@ -7,6 +7,7 @@
 
 #include "add_host_tab.hpp"
 #include "DiscoverManager.hpp"
+#include "MdnsBrowser.hpp"
 #include "helper.hpp"
 #include "main_tabs_view.hpp"
 
@@ -92,40 +93,45 @@ void AddHostTab::findHost() {
     searchSubscription =
         DiscoverManager::instance().getHostsUpdateEvent()->subscribe(
             [this](auto result) { fillSearchBox(result); });
-#else
+#elif defined(PLATFORM_IOS) || defined(PLATFORM_TVOS)
     ASYNC_RETAIN
-#if defined(PLATFORM_IOS) || defined(PLATFORM_TVOS)
     darwin_mdns_start(
-#else
-    GameStreamClient::find_hosts(
-#endif
         [ASYNC_TOKEN](const GSResult<std::vector<Host>>& result) {
             ASYNC_RELEASE
-
-            if (result.isSuccess()) {
-                std::vector<Host> hosts = result.value();
-
-                searchBox->clearViews();
-                for (const Host& host : hosts) {
-                    auto hostButton = new brls::DetailCell();
-                    hostButton->setText(host.hostname);
-                    hostButton->setDetailText(host.address);
-                    hostButton->setDetailTextColor(
-                        brls::Application::getTheme()["brls/text_disabled"]);
-                    hostButton->registerClickAction([this, host](View* view) {
-                        connectHost(host.address);
-                        return true;
-                    });
-                    searchBox->addView(hostButton);
-                }
-//                loader->setVisibility(brls::Visibility::GONE);
-            } else {
-                showError(result.error(), [] {});
-            }
+            showFoundHosts(result);
         });
+#else
+    MdnsBrowser::instance().getHostsUpdateEvent()->unsubscribe(
+        searchSubscription);
+    searchSubscription =
+        MdnsBrowser::instance().getHostsUpdateEvent()->subscribe(
+            [this](auto result) { showFoundHosts(result); });
+    MdnsBrowser::instance().start();
 #endif
 }
 
+void AddHostTab::showFoundHosts(const GSResult<std::vector<Host>>& result) {
+    if (result.isSuccess()) {
+        std::vector<Host> hosts = result.value();
+
+        searchBox->clearViews();
+        for (const Host& host : hosts) {
+            auto hostButton = new brls::DetailCell();
+            hostButton->setText(host.hostname);
+            hostButton->setDetailText(host.address);
+            hostButton->setDetailTextColor(
+                brls::Application::getTheme()["brls/text_disabled"]);
+            hostButton->registerClickAction([this, host](View* view) {
+                connectHost(host.address);
+                return true;
+            });
+            searchBox->addView(hostButton);
+        }
+    } else {
+        showError(result.error(), [] {});
+    }
+}
+
 void AddHostTab::stopSearchHost() {
 #ifdef PLATFORM_IOS
     
@@ -144,7 +150,8 @@ void AddHostTab::connectHost(const std::string& address) {
                 if (result.isSuccess()) {
                     Host host{.address = address,
                               .hostname = result.value().hostname,
-                              .mac = result.value().mac};
+                              .mac = result.value().mac,
+                              .uniqueid = result.value().uniqueid};
 
                     if (result.value().paired) {
                         showAlert("add_host/paired_error"_i18n, [host] {
@@ -186,7 +193,8 @@ void AddHostTab::connectHost(const std::string& address) {
                               [] { AddHostTab::startSearching(); });
                 }
             });
-        });
+        },
+        false);
 }
 
 void AddHostTab::pauseSearching() {
@@ -208,6 +216,10 @@ AddHostTab::~AddHostTab() {
         searchSubscription);
 #elif defined(PLATFORM_IOS) || defined(PLATFORM_TVOS)
     darwin_mdns_stop();
+#else
+    MdnsBrowser::instance().getHostsUpdateEvent()->unsubscribe(
+        searchSubscription);
+    MdnsBrowser::instance().stop();
 #endif
 }
 
@@ -10,47 +10,114 @@
 #include "Settings.hpp"
 #include "streaming_view.hpp"
 
-AppCell::AppCell(const Host& host, const AppInfo& app, int currentApp) {
+AppCell::AppCell(const Host& host) : host(host) {
     this->inflateFromXMLRes("xml/cells/app_cell.xml");
     this->setFavorite(false);
 
-    title->setText(app.name);
     title->setTextColor(nvgRGB(255, 255, 255));
 
-    bool isUnactive = currentApp != 0 && currentApp != app.app_id;
-    unactiveLayer->setVisibility(isUnactive ? Visibility::VISIBLE
-                                            : Visibility::GONE);
-    currentAppImage->setVisibility(
-        currentApp == app.app_id ? Visibility::VISIBLE : Visibility::GONE);
-
     this->addGestureRecognizer(new TapGestureRecognizer(this));
-    this->registerClickAction([host, app](View* view) {
-        auto* frame = new AppletFrame(new StreamingView(host, app));
+    this->registerClickAction([this](View* view) {
+        auto* frame = new AppletFrame(new StreamingView(this->host, this->app));
         frame->setBackground(ViewBackground::NONE);
         frame->setHeaderVisibility(brls::Visibility::GONE);
         frame->setFooterVisibility(brls::Visibility::GONE);
         Application::pushActivity(new Activity(frame));
         return true;
     });
-    this->setActionAvailable(BUTTON_A, !isUnactive);
+}
 
-    if (BoxArtManager::instance().has_boxart(app.app_id))
-        image->setImageFromFile(
-            BoxArtManager::get_texture_path(app.app_id));
-    else {
-        ASYNC_RETAIN
-        GameStreamClient::instance().app_boxart(
-            host.address, app.app_id, [ASYNC_TOKEN, host, app](auto result) {
-                ASYNC_RELEASE
-
-                if (result.isSuccess()) {
-                    BoxArtManager::instance().set_data(result.value(),
-                                                       app.app_id);
-                    image->setImageFromFile(
-                        BoxArtManager::get_texture_path(app.app_id));
-                }
-            });
+AppCell::AppCell(const Host& host, const AppInfo& app, int currentApp)
+    : AppCell(host) {
+    update(app, currentApp);
+}
+
+AppCell::~AppCell() {
+    if (boxArtTicket)
+        BoxArtManager::instance().cancel(boxArtTicket);
+}
+
+void AppCell::bind(const Host& host, const AppInfo& app, int currentApp) {
+    // The host learns its uniqueid after the first connect, which moves its
+    // box art to another manifest key
+    if (app.app_id != this->app.app_id ||
+        host.uniqueid != this->host.uniqueid ||
+        host.address != this->host.address)
+        resetBoxArt();
+    this->host = host;
+    update(app, currentApp);
+}
+
+void AppCell::resetBoxArt() {
+    if (boxArtTicket) {
+        BoxArtManager::instance().cancel(boxArtTicket);
+        boxArtTicket = 0;
     }
+
+    boxArtHash.clear();
+    boxArtFailed = false;
+    image->innerSetImage(0);
+}
+
+void AppCell::setPrefetchPriority(int priority) {
+    if (!boxArtHash.empty() || boxArtFailed)
+        return;
+
+    if (priority < 0) {
+        if (boxArtTicket) {
+            BoxArtManager::instance().cancel(boxArtTicket);
+            boxArtTicket = 0;
+        }
+    } else if (boxArtTicket) {
+        BoxArtManager::instance().reprioritize(boxArtTicket, priority);
+    } else {
+        loadBoxArt(priority);
+    }
+}
+
+void AppCell::loadBoxArt(int priority) {
+    boxArtTicket = BoxArtManager::instance().request(
+        host, app.app_id, priority,
+        [this](const GSResult<BoxArtImage>& result) {
+            boxArtTicket = 0;
+
+            if (result.isSuccess()) {
+                // The texture belongs to the manager's LRU, the image only
+                // borrows it
+                int texture = BoxArtManager::instance().make_texture(
+                    Application::getNVGContext(), result.value());
+                boxArtHash = texture > 0 ? result.value().hash : "";
+                image->setFreeTexture(false);
+                image->innerSetImage(texture);
+            } else {
+                boxArtFailed = true;
+            }
+        });
+}
+
+void AppCell::draw(NVGcontext* vg, float x, float y, float width,
+                   float height, Style style, FrameContext* ctx) {
+    // Scrolled back into view after the texture was evicted
+    if (!boxArtHash.empty() &&
+        !BoxArtManager::instance().touch_texture(boxArtHash)) {
+        boxArtHash.clear();
+        image->innerSetImage(0);
+        loadBoxArt(0);
+    }
+
+    Box::draw(vg, x, y, width, height, style, ctx);
+}
+
+void AppCell::update(const AppInfo& app, int currentApp) {
+    this->app = app;
+    title->setText(app.name);
+
+    bool isUnactive = currentApp != 0 && currentApp != app.app_id;
+    unactiveLayer->setVisibility(isUnactive ? Visibility::VISIBLE
+                                            : Visibility::GONE);
+    currentAppImage->setVisibility(
+        currentApp == app.app_id ? Visibility::VISIBLE : Visibility::GONE);
+    this->setActionAvailable(BUTTON_A, !isUnactive);
 }
 
 void AppCell::setFavorite(bool favorite) {
@@ -6,8 +6,10 @@
 //
 
 #include "app_list_view.hpp"
+#include "AppListCache.hpp"
 #include "helper.hpp"
 #include "main_tabs_view.hpp"
+#include <chrono>
 
 AppListView::AppListView(const Host& host) : host(host) {
     this->inflateFromXMLRes("xml/views/app_list_view.xml");
@@ -30,6 +32,7 @@ AppListView::AppListView(const Host& host) : host(host) {
 
     container->setHideHighlight(true);
     gridView = new GridView();
+    gridView->setDataSource(this);
     container->addView(gridView);
     loader = new LoadingOverlay(this);
 
@@ -59,6 +62,17 @@ AppListView::AppListView(const Host& host) : host(host) {
                        this->updateAppList();
                        return true;
                    });
+
+    registerAction("app_list/search"_i18n, BUTTON_START, [this](View* view) {
+        Application::getPlatform()->getImeManager()->openForText(
+            [this](const std::string& text) {
+                filter = text;
+                applyFilter();
+                Application::giveFocus(this);
+            },
+            "app_list/search"_i18n, "", 64, filter, 0);
+        return true;
+    });
     blockInput(true);
 }
 
@@ -87,7 +101,6 @@ void AppListView::terninateApp() {
             return;
 
         loading = true;
-        gridView->clearViews();
         Application::giveFocus(this);
         loader->setHidden(false);
         blockInput(true);
@@ -116,16 +129,34 @@ void AppListView::updateAppList() {
 
     loading = true;
 
-    gridView->clearViews();
-    Application::giveFocus(this);
-    loader->setHidden(false);
     currentApp = std::nullopt;
     hintView->setVisibility(Visibility::GONE);
-    blockInput(true);
 
     getAppletFrameItem()->title = host.hostname;
     updateAppletFrameItem();
 
+    // Draw the last known list right away and patch it once the host answers
+    auto startTime = std::chrono::steady_clock::now();
+    AppInfoList cachedApps = AppListCache::instance().load(host.uniqueid);
+    if (!cachedApps.empty()) {
+        showApps(cachedApps, 0);
+        loader->setHidden(true);
+        blockInput(false);
+
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - startTime);
+        brls::Logger::debug("AppListView: Drew {} cached apps in {} ms",
+                            cachedApps.size(), elapsed.count());
+    } else {
+        apps.clear();
+        searchIndex = AppSearchIndex();
+        visibleApps.clear();
+        gridView->reloadData();
+        Application::giveFocus(this);
+        loader->setHidden(false);
+        blockInput(true);
+    }
+
     ASYNC_RETAIN
     GameStreamClient::instance().connect(
         host.address, [ASYNC_TOKEN](const GSResult<SERVER_DATA>& result) {
@@ -134,6 +165,12 @@ void AppListView::updateAppList() {
             if (result.isSuccess()) {
                 int currentGame = result.value().currentGame;
 
+                if (!result.value().uniqueid.empty() &&
+                    result.value().uniqueid != host.uniqueid) {
+                    host.uniqueid = result.value().uniqueid;
+                    Settings::instance().add_host(host);
+                }
+
                 ASYNC_RETAIN
                 GameStreamClient::instance().applist(
                     host.address,
@@ -145,47 +182,81 @@ void AppListView::updateAppList() {
                         blockInput(false);
 
                         if (result.isSuccess()) {
-                            AppInfoList sortedApps = result.value();
-                            std::sort(
-                                sortedApps.begin(), sortedApps.end(),
-                                [this, currentGame](const AppInfo& l, const AppInfo& r) {
-                                    int lScore = 0;
-                                    int rScore = 0;
-
-                                    if (l.app_id == currentGame) lScore+=2;
-                                    if (Settings::instance().is_favorite(this->host, l.app_id)) lScore+=1;
-
-                                    if (r.app_id == currentGame) rScore+=2;
-                                    if (Settings::instance().is_favorite(this->host, r.app_id)) rScore+=1;
-
-                                    return lScore > rScore;
-                                });
-
-                            for (const AppInfo& app : sortedApps) {
-                                if (app.app_id == currentGame)
-                                    setCurrentApp(app);
-
-                                auto* cell =
-                                    new AppCell(host, app, currentGame);
-                                cell->setFavorite(
-                                    Settings::instance().is_favorite(
-                                        host, app.app_id));
-                                gridView->addView(cell);
-                                this->updateFavoriteAction(cell, host, app);
-                            }
-                            Application::giveFocus(this);
+                            AppListCache::instance().store(host.uniqueid,
+                                                           result.value());
+                            showApps(result.value(), currentGame);
                         } else {
                             showError(result.error(),
                                       [this] { this->dismiss(); });
                         }
                     });
             } else {
+                loading = false;
+                loader->setHidden(true);
                 blockInput(false);
                 showError(result.error(), [this] { this->dismiss(); });
             }
         });
 }
 
+void AppListView::showApps(const AppInfoList& newApps, int currentGame) {
+    AppInfoList sortedApps = newApps;
+    std::stable_sort(
+        sortedApps.begin(), sortedApps.end(),
+        [this, currentGame](const AppInfo& l, const AppInfo& r) {
+            int lScore = 0;
+            int rScore = 0;
+
+            if (l.app_id == currentGame) lScore+=2;
+            if (Settings::instance().is_favorite(this->host, l.app_id)) lScore+=1;
+
+            if (r.app_id == currentGame) rScore+=2;
+            if (Settings::instance().is_favorite(this->host, r.app_id)) rScore+=1;
+
+            return lScore > rScore;
+        });
+
+    for (const AppInfo& app : sortedApps) {
+        if (app.app_id == currentGame)
+            setCurrentApp(app);
+    }
+
+    // The grid only rebinds the cells that are on screen, a cell that still
+    // shows the same app keeps its box art
+    bool wasEmpty = this->apps.empty();
+    this->apps = std::move(sortedApps);
+    this->currentGame = currentGame;
+    searchIndex = AppSearchIndex(this->apps);
+    applyFilter();
+
+    if (wasEmpty)
+        Application::giveFocus(this);
+}
+
+void AppListView::applyFilter() {
+    // Filtering only swaps the index list, the grid rebinds the cells it has
+    auto startTime = std::chrono::steady_clock::now();
+    visibleApps = searchIndex.search(filter);
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - startTime);
+    brls::Logger::debug("AppListView: \"{}\" matched {} of {} apps in {} us",
+                        filter, visibleApps.size(), apps.size(),
+                        elapsed.count());
+
+    gridView->reloadData();
+}
+
+View* AppListView::createItem() { return new AppCell(host); }
+
+void AppListView::bindItem(View* view, size_t index) {
+    auto* cell = (AppCell*)view;
+    const AppInfo& app = apps[visibleApps[index]];
+
+    cell->bind(host, app, currentGame);
+    cell->setFavorite(Settings::instance().is_favorite(host, app.app_id));
+    this->updateFavoriteAction(cell, host, app);
+}
+
 void AppListView::setCurrentApp(const AppInfo& app) {
     this->currentApp = app;
     hintView->setVisibility(Visibility::VISIBLE);
@@ -0,0 +1,65 @@
+#include "ClientIdentity.hpp"
+#include "CryptoManager.hpp"
+#include <borealis.hpp>
+#include <chrono>
+
+using Clock = std::chrono::steady_clock;
+
+ClientIdentity::~ClientIdentity() {
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+void ClientIdentity::start() {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    if (m_started)
+        return;
+
+    m_started = true;
+
+    // Reading two small files is cheap enough to do right away, and lets
+    // paired hosts be asked over HTTPS from the first request on
+    if (CryptoManager::load_cert_key_pair()) {
+        m_promise.set_value(true);
+        return;
+    }
+
+    brls::Logger::info("ClientIdentity: No certs, generating new ones...");
+    m_thread = std::thread([this] {
+        auto start = Clock::now();
+        bool generated = CryptoManager::generate_new_cert_key_pair();
+
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+            Clock::now() - start);
+        if (generated) {
+            brls::Logger::info("ClientIdentity: Generated certs in {} ms",
+                               elapsed.count());
+        } else {
+            brls::Logger::error("ClientIdentity: Failed to generate certs "
+                                "after {} ms",
+                                elapsed.count());
+        }
+
+        m_promise.set_value(generated);
+    });
+}
+
+bool ClientIdentity::is_generating() {
+    start();
+    return m_future.wait_for(std::chrono::seconds(0)) !=
+           std::future_status::ready;
+}
+
+bool ClientIdentity::wait() {
+    if (!is_generating())
+        return m_future.get();
+
+    auto start = Clock::now();
+    bool available = m_future.get();
+    brls::Logger::info(
+        "ClientIdentity: Waited {} ms for the certs",
+        std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() -
+                                                              start)
+            .count());
+    return available;
+}
@@ -0,0 +1,29 @@
+#include "Singleton.hpp"
+#include <future>
+#include <mutex>
+#include <thread>
+#pragma once
+
+// The client certificate and key the hosts know us by. A missing identity
+// is generated on a background thread, so only requests that actually need
+// it have to wait for the RSA key generation.
+class ClientIdentity : public Singleton<ClientIdentity> {
+  public:
+    ~ClientIdentity();
+
+    // Loads the stored identity, or starts generating a new one
+    void start();
+
+    // True while a new identity is being generated
+    bool is_generating();
+
+    // Blocks until the identity is available, false if it failed
+    bool wait();
+
+  private:
+    std::mutex m_mutex;
+    bool m_started = false;
+    std::promise<bool> m_promise;
+    std::shared_future<bool> m_future = m_promise.get_future().share();
+    std::thread m_thread;
+};
@@ -1,113 +1,171 @@
 #include "Data.hpp"
 #include <borealis.hpp>
 #include <cstdlib>
+#include <ctime>
+#include <new>
 #include <string.h>
 
-Data::Data(unsigned char* bytes, size_t size) {
-    if (bytes && size > 0) {
-        m_bytes = (unsigned char*)malloc(size + 1);
-        m_bytes[size] = '\0';
-        memcpy(m_bytes, bytes, size);
-        m_size = size;
+Data::Buffer* Data::allocate(size_t capacity) {
+    auto* buffer = (Buffer*)malloc(sizeof(Buffer) + capacity + 1);
+    if (!buffer) {
+        brls::Logger::error("Data: Out of memory...");
+        exit(-1);
     }
-}
 
-Data::Data(size_t capacity) {
-    m_bytes = (unsigned char*)malloc(capacity + 1);
-    memset(m_bytes, 0, capacity + 1);
-    m_bytes[capacity] = '\0';
-    m_size = capacity;
+    new (&buffer->refs) std::atomic<int>(1);
+    buffer->capacity = capacity;
+    buffer->bytes()[capacity] = '\0';
+    s_allocations++;
+    return buffer;
 }
 
-Data::~Data() {
-    if (m_bytes) {
-        free(m_bytes);
-    }
-}
+Data::Buffer* Data::reallocate(Buffer* buffer, size_t capacity) {
+    if (!buffer)
+        return allocate(capacity);
 
-Data Data::subdata(size_t start, size_t size) {
-    if (start + size > m_size) {
-        brls::Logger::error("Data: Invalid data length...");
+    // Only called on buffers owned by a single DataBuilder
+    buffer = (Buffer*)realloc(buffer, sizeof(Buffer) + capacity + 1);
+    if (!buffer) {
+        brls::Logger::error("Data: Out of memory...");
         exit(-1);
     }
-    return Data(&m_bytes[start], size);
+
+    buffer->capacity = capacity;
+    s_allocations++;
+    return buffer;
 }
 
-Data Data::append(Data other) {
-    if (is_empty()) {
-        return other;
+void Data::retain(Buffer* buffer) {
+    if (buffer)
+        buffer->refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Data::release(Buffer* buffer) {
+    if (buffer && buffer->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        buffer->refs.~atomic();
+        free(buffer);
     }
+}
 
-    Data data(m_size + other.m_size);
-    memcpy(data.m_bytes, m_bytes, m_size);
-    memcpy(&data.m_bytes[m_size], other.m_bytes, other.m_size);
-    return data;
+Data::Data(const unsigned char* bytes, size_t size) {
+    if (bytes && size > 0) {
+        m_buffer = allocate(size);
+        memcpy(m_buffer->bytes(), bytes, size);
+        m_size = size;
+    }
 }
 
-Data::Data(const Data& that) : Data(0) {
-    if (m_bytes) {
-        free(m_bytes);
+Data::Data(size_t capacity) {
+    if (capacity > 0) {
+        m_buffer = allocate(capacity);
+        memset(m_buffer->bytes(), 0, capacity);
+        m_size = capacity;
     }
+}
+
+Data::~Data() { release(m_buffer); }
+
+Data::Data(const Data& that)
+    : m_buffer(that.m_buffer), m_offset(that.m_offset), m_size(that.m_size) {
+    retain(m_buffer);
+}
 
-    m_bytes = (unsigned char*)malloc(that.size() + 1);
-    memcpy(m_bytes, that.m_bytes, that.m_size);
-    m_bytes[that.m_size] = '\0';
-    m_size = that.m_size;
+Data::Data(Data&& that) noexcept
+    : m_buffer(that.m_buffer), m_offset(that.m_offset), m_size(that.m_size) {
+    that.m_buffer = nullptr;
+    that.m_offset = 0;
+    that.m_size = 0;
 }
 
 Data& Data::operator=(const Data& that) {
     if (this != &that) {
-        if (m_bytes) {
-            free(m_bytes);
-        }
+        retain(that.m_buffer);
+        release(m_buffer);
+        m_buffer = that.m_buffer;
+        m_offset = that.m_offset;
+        m_size = that.m_size;
+    }
+    return *this;
+}
 
-        m_bytes = (unsigned char*)malloc(that.m_size + 1);
-        memcpy(m_bytes, that.m_bytes, that.m_size);
-        m_bytes[that.m_size] = '\0';
+Data& Data::operator=(Data&& that) noexcept {
+    if (this != &that) {
+        release(m_buffer);
+        m_buffer = that.m_buffer;
+        m_offset = that.m_offset;
         m_size = that.m_size;
+        that.m_buffer = nullptr;
+        that.m_offset = 0;
+        that.m_size = 0;
     }
     return *this;
 }
 
-Data Data::random_bytes(size_t size) {
-    unsigned char* bytes = (unsigned char*)malloc(sizeof(char) * size);
+Data Data::subdata(size_t start, size_t size) const {
+    if (start + size > m_size) {
+        brls::Logger::error("Data: Invalid data length...");
+        exit(-1);
+    }
 
+    Data data;
+    if (size > 0) {
+        data = *this;
+        data.m_offset = m_offset + start;
+        data.m_size = size;
+    }
+    return data;
+}
+
+Data Data::append(const Data& other) const {
+    if (is_empty()) {
+        return other;
+    } else if (other.is_empty()) {
+        return *this;
+    }
+
+    Data data(m_size + other.m_size);
+    memcpy(data.bytes(), bytes(), m_size);
+    memcpy(data.bytes() + m_size, other.bytes(), other.m_size);
+    return data;
+}
+
+Data Data::random_bytes(size_t size) {
 #ifndef _WIN32
     srand(time(NULL));
 #endif
 
-    for (int i = 0; i < size; i++) {
+    Data random_data(size);
+    unsigned char* bytes = random_data.bytes();
+    for (size_t i = 0; i < size; i++) {
         bytes[i] = rand() % 255;
     }
-
-    Data random_data(size);
-    memcpy(random_data.m_bytes, bytes, size);
-    free(bytes);
     return random_data;
 }
 
 Data Data::read_from_file(std::string path) {
-    FILE* f = fopen(path.c_str(), "r");
+    FILE* f = fopen(path.c_str(), "rb");
     if (f) {
         fseek(f, 0, SEEK_END);
-        int size = (int)ftell(f);
+        long size = ftell(f);
         fseek(f, 0, SEEK_SET);
 
-        char* buffer = (char*)malloc(size);
-        fread(buffer, 1, size, f);
+        if (size <= 0) {
+            fclose(f);
+            return Data();
+        }
 
-        Data data(buffer, size);
-        free(buffer);
+        Data data((size_t)size);
+        data.m_size = fread(data.bytes(), 1, size, f);
         fclose(f);
         return data;
     }
     return Data();
 }
 
-void Data::write_to_file(std::string path) {
-    FILE* f = fopen(path.c_str(), "w");
+void Data::write_to_file(std::string path) const {
+    FILE* f = fopen(path.c_str(), "wb");
     if (f) {
-        fwrite(m_bytes, m_size, 1, f);
+        fwrite(bytes(), m_size, 1, f);
         fclose(f);
     } else {
         brls::Logger::error("Data: Path not found: %s", path.c_str());
@@ -116,15 +174,16 @@ void Data::write_to_file(std::string path) {
 
 Data Data::hex_to_bytes() const {
     Data data(m_size / 2);
+    const unsigned char* src = bytes();
     char byte_chars[3] = {'\0', '\0', '\0'};
     unsigned long whole_byte;
 
-    int i = 0, counter = 0;
-    while (i < m_size) {
-        byte_chars[0] = m_bytes[i++];
-        byte_chars[1] = m_bytes[i++];
+    size_t i = 0, counter = 0;
+    while (i + 1 < m_size) {
+        byte_chars[0] = src[i++];
+        byte_chars[1] = src[i++];
         whole_byte = strtoul(byte_chars, NULL, 16);
-        data.m_bytes[counter++] = whole_byte;
+        data.bytes()[counter++] = whole_byte;
     }
     return data;
 }
@@ -135,14 +194,68 @@ Data Data::hex() const {
         return Data(&end, 1);
     }
 
-    int counter = 0;
+    static const char digits[] = "0123456789ABCDEF";
+
     Data hex(m_size * 2);
-    char fmt[3] = {'\0', '\0', '\0'};
-    for (int i = 0; i < m_size; i++) {
-        sprintf(fmt, "%02X", m_bytes[i]);
-        hex.m_bytes[counter++] = fmt[0];
-        hex.m_bytes[counter++] = fmt[1];
+    const unsigned char* src = bytes();
+    unsigned char* dst = hex.bytes();
+    for (size_t i = 0; i < m_size; i++) {
+        *dst++ = digits[src[i] >> 4];
+        *dst++ = digits[src[i] & 0x0F];
     }
-    hex.m_bytes[m_size * 2] = '\0';
     return hex;
 }
+
+DataBuilder::~DataBuilder() { Data::release(m_buffer); }
+
+void DataBuilder::reserve(size_t capacity) {
+    if (m_buffer && m_buffer->capacity >= capacity)
+        return;
+
+    m_buffer = Data::reallocate(m_buffer, capacity);
+}
+
+void DataBuilder::recycle(Data&& data) {
+    Data::Buffer* buffer = data.m_buffer;
+    if (buffer && buffer->refs.load(std::memory_order_acquire) == 1) {
+        Data::release(m_buffer);
+        m_buffer = buffer;
+        m_size = 0;
+
+        data.m_buffer = nullptr;
+        data.m_offset = 0;
+        data.m_size = 0;
+    } else {
+        data = Data();
+    }
+}
+
+DataBuilder& DataBuilder::append(const void* bytes, size_t size) {
+    if (size == 0)
+        return *this;
+
+    size_t capacity = m_buffer ? m_buffer->capacity : 0;
+    if (m_size + size > capacity) {
+        reserve(std::max(m_size + size, capacity * 2));
+    }
+
+    memcpy(m_buffer->bytes() + m_size, bytes, size);
+    m_size += size;
+    m_buffer->bytes()[m_size] = '\0';
+    return *this;
+}
+
+Data DataBuilder::build() {
+    Data data;
+    if (m_size > 0) {
+        data.m_buffer = m_buffer;
+        data.m_size = m_size;
+        m_buffer->bytes()[m_size] = '\0';
+    } else {
+        Data::release(m_buffer);
+    }
+
+    m_buffer = nullptr;
+    m_size = 0;
+    return data;
+}
@@ -1,36 +1,98 @@
+#include <atomic>
 #include <stdio.h>
 #include <string>
 #pragma once
 
+// Refcounted byte buffer. Copies and subdata() share the same storage, so
+// writing through bytes() is only safe on a buffer you have just created.
+// Owning buffers are always followed by a '\0'; subdata() views are not.
 class Data {
   public:
-    Data() : Data(0){};
-    Data(unsigned char* bytes, size_t size);
-    Data(char* bytes, size_t size) : Data((unsigned char*)bytes, size){};
+    Data() = default;
+    Data(const unsigned char* bytes, size_t size);
+    Data(const char* bytes, size_t size)
+        : Data((const unsigned char*)bytes, size){};
     Data(size_t capacity);
 
     ~Data();
 
-    unsigned char* bytes() const { return m_bytes; }
+    unsigned char* bytes() const {
+        return m_buffer ? m_buffer->bytes() + m_offset : s_empty;
+    }
 
     size_t size() const { return m_size; }
 
-    Data subdata(size_t start, size_t size);
-    Data append(Data other);
+    Data subdata(size_t start, size_t size) const;
+    Data append(const Data& other) const;
 
     Data(const Data& that);
+    Data(Data&& that) noexcept;
     Data& operator=(const Data& that);
+    Data& operator=(Data&& that) noexcept;
 
     static Data random_bytes(size_t size);
     static Data read_from_file(std::string path);
-    void write_to_file(std::string path);
+    void write_to_file(std::string path) const;
 
     Data hex_to_bytes() const;
     Data hex() const;
 
     bool is_empty() const { return m_size == 0; }
 
+    // Number of heap buffers created (or grown) since launch
+    static size_t allocations() { return s_allocations.load(); }
+
+  private:
+    friend class DataBuilder;
+
+    struct Buffer {
+        std::atomic<int> refs;
+        size_t capacity;
+
+        unsigned char* bytes() { return (unsigned char*)(this + 1); }
+    };
+
+    static Buffer* allocate(size_t capacity);
+    static Buffer* reallocate(Buffer* buffer, size_t capacity);
+    static void retain(Buffer* buffer);
+    static void release(Buffer* buffer);
+
+    Buffer* m_buffer = nullptr;
+    size_t m_offset = 0;
+    size_t m_size = 0;
+
+    static inline unsigned char s_empty[1] = {0};
+    static inline std::atomic<size_t> s_allocations = 0;
+};
+
+// Accumulates bytes into a single growing buffer and hands it over to a Data
+// without copying. Use it instead of chained Data::append() calls.
+class DataBuilder {
+  public:
+    DataBuilder() = default;
+    explicit DataBuilder(size_t capacity) { reserve(capacity); }
+    ~DataBuilder();
+
+    DataBuilder(const DataBuilder&) = delete;
+    DataBuilder& operator=(const DataBuilder&) = delete;
+
+    void reserve(size_t capacity);
+
+    // Takes over the storage of data for reuse if nothing else references
+    // it, otherwise just drops the reference
+    void recycle(Data&& data);
+
+    DataBuilder& append(const void* bytes, size_t size);
+    DataBuilder& append(const Data& data) {
+        return append(data.bytes(), data.size());
+    }
+
+    size_t size() const { return m_size; }
+
+    // Moves the accumulated bytes into a Data, leaving the builder empty
+    Data build();
+
   private:
-    unsigned char* m_bytes = nullptr;
+    Data::Buffer* m_buffer = nullptr;
     size_t m_size = 0;
 };
@@ -10,11 +10,87 @@
 #include <mbedtls/sha256.h>
 #include <mbedtls/x509.h>
 #include <mbedtls/x509_crt.h>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string.h>
 
 static Data m_cert;
 static Data m_key;
 
+// Parsed certs and keys and a seeded DRBG are kept around instead of being
+// rebuilt on every call. mbedTLS contexts are not thread safe, so they are
+// only touched with s_mutex held.
+struct ParsedCert {
+    mbedtls_x509_crt crt;
+    ParsedCert() { mbedtls_x509_crt_init(&crt); }
+    ~ParsedCert() { mbedtls_x509_crt_free(&crt); }
+};
+
+struct ParsedKey {
+    mbedtls_pk_context pk;
+    ParsedKey() { mbedtls_pk_init(&pk); }
+    ~ParsedKey() { mbedtls_pk_free(&pk); }
+};
+
+// Our own cert plus the ones of hosts being paired
+static const size_t max_cached_certs = 8;
+
+static std::mutex s_mutex;
+static std::map<std::string, std::unique_ptr<ParsedCert>> s_certs;
+static std::map<std::string, std::unique_ptr<ParsedKey>> s_keys;
+static bool s_drbg_seeded = false;
+static mbedtls_entropy_context s_entropy;
+static mbedtls_ctr_drbg_context s_ctr_drbg;
+
+static mbedtls_ctr_drbg_context* _drbg() {
+    if (!s_drbg_seeded) {
+        mbedtls_entropy_init(&s_entropy);
+        mbedtls_ctr_drbg_init(&s_ctr_drbg);
+        if (mbedtls_ctr_drbg_seed(&s_ctr_drbg, mbedtls_entropy_func,
+                                  &s_entropy, NULL, 0) != 0) {
+            mbedtls_ctr_drbg_free(&s_ctr_drbg);
+            mbedtls_entropy_free(&s_entropy);
+            return nullptr;
+        }
+        s_drbg_seeded = true;
+    }
+    return &s_ctr_drbg;
+}
+
+static mbedtls_x509_crt* _parsed_cert(const Data& cert) {
+    std::string pem((const char*)cert.bytes(), cert.size());
+    auto it = s_certs.find(pem);
+    if (it != s_certs.end())
+        return &it->second->crt;
+
+    // PEM input has to include the terminating '\0' in its length
+    auto parsed = std::make_unique<ParsedCert>();
+    if (mbedtls_x509_crt_parse(&parsed->crt, (const unsigned char*)pem.c_str(),
+                               pem.size() + 1) != 0)
+        return nullptr;
+
+    if (s_certs.size() >= max_cached_certs)
+        s_certs.clear();
+    return &(s_certs[pem] = std::move(parsed))->crt;
+}
+
+static mbedtls_pk_context* _parsed_key(const Data& key) {
+    std::string pem((const char*)key.bytes(), key.size());
+    auto it = s_keys.find(pem);
+    if (it != s_keys.end())
+        return &it->second->pk;
+
+    auto parsed = std::make_unique<ParsedKey>();
+    if (mbedtls_pk_parse_key(&parsed->pk, (const unsigned char*)pem.c_str(),
+                             pem.size() + 1, NULL, 0) != 0)
+        return nullptr;
+
+    // Only one identity is in use at a time
+    s_keys.clear();
+    return &(s_keys[pem] = std::move(parsed))->pk;
+}
+
 static bool _generate_new_cert_key_pair();
 
 bool MbedTLSCryptoManager::load_cert_key_pair() {
@@ -25,8 +101,8 @@ bool MbedTLSCryptoManager::load_cert_key_pair() {
                                         KEY_FILE_NAME);
 
         if (!cert.is_empty() && !key.is_empty()) {
-            m_cert = cert;
-            m_key = key;
+            m_cert = std::move(cert);
+            m_key = std::move(key);
             return true;
         }
         return false;
@@ -59,7 +135,7 @@ Data MbedTLSCryptoManager::cert_data() { return m_cert; }
 
 Data MbedTLSCryptoManager::key_data() { return m_key; }
 
-Data MbedTLSCryptoManager::SHA1_hash_data(Data data) {
+Data MbedTLSCryptoManager::SHA1_hash_data(const Data& data) {
     mbedtls_sha1_context ctx;
     unsigned char sha1[20];
     mbedtls_sha1_init(&ctx);
@@ -68,7 +144,7 @@ Data MbedTLSCryptoManager::SHA1_hash_data(Data data) {
     return Data(sha1, sizeof(sha1));
 }
 
-Data MbedTLSCryptoManager::SHA256_hash_data(Data data) {
+Data MbedTLSCryptoManager::SHA256_hash_data(const Data& data) {
     mbedtls_sha256_context ctx;
     unsigned char sha256[32];
     mbedtls_sha256_init(&ctx);
@@ -77,104 +153,142 @@ Data MbedTLSCryptoManager::SHA256_hash_data(Data data) {
     return Data(sha256, sizeof(sha256));
 }
 
-Data MbedTLSCryptoManager::create_AES_key_from_salt_SHA1(Data salted_pin) {
+Data MbedTLSCryptoManager::create_AES_key_from_salt_SHA1(const Data& salted_pin) {
     return SHA1_hash_data(salted_pin).subdata(0, 16);
 }
 
-Data MbedTLSCryptoManager::create_AES_key_from_salt_SHA256(Data salted_pin) {
+Data MbedTLSCryptoManager::create_AES_key_from_salt_SHA256(const Data& salted_pin) {
     return SHA256_hash_data(salted_pin).subdata(0, 16);
 }
 
-static int get_encrypt_size(Data data) {
+static int get_encrypt_size(const Data& data) {
     // the size is the length of the data ceiling to the nearest 16 bytes
     return (((int)data.size() + 15) / 16) * 16;
 }
 
-Data MbedTLSCryptoManager::aes_encrypt(Data data, Data key) {
+// AES-128-ECB over whole blocks, in and out may be the same buffer. The
+// mbedtls_cipher ECB mode only takes a single block per update call, so this
+// stays on one aes context, which picks AES-NI or the ARMv8 crypto extensions
+// at runtime when they are compiled in.
+static bool _aes_ecb(const Data& key, bool encrypt, const unsigned char* in,
+                     unsigned char* out, int size) {
+    mbedtls_aes_context ctx;
+    mbedtls_aes_init(&ctx);
+
+    int ret = encrypt ? mbedtls_aes_setkey_enc(&ctx, key.bytes(), 128)
+                      : mbedtls_aes_setkey_dec(&ctx, key.bytes(), 128);
+    int mode = encrypt ? MBEDTLS_AES_ENCRYPT : MBEDTLS_AES_DECRYPT;
+    for (int offset = 0; ret == 0 && offset < size; offset += 16)
+        ret = mbedtls_aes_crypt_ecb(&ctx, mode, in + offset, out + offset);
+
+    mbedtls_aes_free(&ctx);
+    return ret == 0;
+}
+
+Data MbedTLSCryptoManager::aes_encrypt(const Data& data, const Data& key) {
+    // Zero padded up to the block size, encrypted in place
+    int size = get_encrypt_size(data);
+    Data encrypted_data(size);
+    unsigned char* buffer = encrypted_data.bytes();
+    memcpy(buffer, data.bytes(), data.size());
+
+    if (!_aes_ecb(key, true, buffer, buffer, size))
+        return Data();
+    return encrypted_data;
+}
+
+Data MbedTLSCryptoManager::aes_decrypt(const Data& data, const Data& key) {
+    // A trailing partial block is left zeroed
+    Data decrypted_data(data.size());
+    int size = (int)data.size() & ~15;
+
+    if (!_aes_ecb(key, false, data.bytes(), decrypted_data.bytes(), size))
+        return Data();
+    return decrypted_data;
+}
+
+Data MbedTLSCryptoManager::aes_encrypt_reference(const Data& data, const Data& key) {
     mbedtls_aes_context ctx;
     mbedtls_aes_init(&ctx);
     mbedtls_aes_setkey_enc(&ctx, key.bytes(), 128);
 
     int size = get_encrypt_size(data);
-    unsigned char* buffer = (unsigned char*)malloc(size);
-    unsigned char* block_rounded_buffer = (unsigned char*)calloc(1, size);
-    memcpy(block_rounded_buffer, data.bytes(), data.size());
+    Data encrypted_data(size);
+    unsigned char* buffer = encrypted_data.bytes();
+    memcpy(buffer, data.bytes(), data.size());
 
     int block_offset = 0;
     while (block_offset < size) {
-        mbedtls_aes_crypt_ecb(&ctx, MBEDTLS_AES_ENCRYPT,
-                              block_rounded_buffer + block_offset,
+        mbedtls_aes_crypt_ecb(&ctx, MBEDTLS_AES_ENCRYPT, buffer + block_offset,
                               buffer + block_offset);
         block_offset += 16;
     }
 
-    Data encrypted_data = Data((char*)buffer, size);
     mbedtls_aes_free(&ctx);
-    free(buffer);
-    free(block_rounded_buffer);
     return encrypted_data;
 }
 
-Data MbedTLSCryptoManager::aes_decrypt(Data data, Data key) {
+Data MbedTLSCryptoManager::aes_decrypt_reference(const Data& data, const Data& key) {
     mbedtls_aes_context ctx;
     mbedtls_aes_init(&ctx);
     mbedtls_aes_setkey_dec(&ctx, key.bytes(), 128);
-    unsigned char* buffer = (unsigned char*)malloc(data.size());
+
+    Data decrypted_data(data.size());
+    unsigned char* buffer = decrypted_data.bytes();
 
     int block_offset = 0;
-    while (block_offset < data.size()) {
+    while (block_offset + 16 <= data.size()) {
         mbedtls_aes_crypt_ecb(&ctx, MBEDTLS_AES_DECRYPT,
                               data.bytes() + block_offset,
                               buffer + block_offset);
         block_offset += 16;
     }
 
-    Data decrypted_data = Data(buffer, data.size());
     mbedtls_aes_free(&ctx);
-    free(buffer);
     return decrypted_data;
 }
 
-Data MbedTLSCryptoManager::signature(Data cert) {
-    mbedtls_x509_crt x509;
-    mbedtls_x509_crt_init(&x509);
+Data MbedTLSCryptoManager::signature(const Data& cert) {
+    std::lock_guard<std::mutex> guard(s_mutex);
 
-    mbedtls_x509_crt_parse(&x509, cert.bytes(), cert.size() + 1);
+    mbedtls_x509_crt* x509 = _parsed_cert(cert);
+    if (!x509)
+        return Data();
 
-    Data data(x509.sig.p, x509.sig.len);
-    mbedtls_x509_crt_free(&x509);
-    return data;
+    return Data(x509->sig.p, x509->sig.len);
 }
 
-bool MbedTLSCryptoManager::verify_signature(Data data, Data signature,
-                                            Data cert) {
-    // TODO
-    return true;
+bool MbedTLSCryptoManager::verify_signature(const Data& data,
+                                            const Data& signature,
+                                            const Data& cert) {
+    std::lock_guard<std::mutex> guard(s_mutex);
+
+    mbedtls_x509_crt* x509 = _parsed_cert(cert);
+    if (!x509)
+        return false;
+
+    unsigned char hash[32];
+    mbedtls_md(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), data.bytes(),
+               data.size(), hash);
+    return mbedtls_pk_verify(&x509->pk, MBEDTLS_MD_SHA256, hash, 0,
+                             signature.bytes(), signature.size()) == 0;
 }
 
-Data MbedTLSCryptoManager::sign_data(Data data, Data key) {
-    mbedtls_pk_context pk;
-    mbedtls_entropy_context entropy;
-    mbedtls_ctr_drbg_context ctr_drbg;
+Data MbedTLSCryptoManager::sign_data(const Data& data, const Data& key) {
+    std::lock_guard<std::mutex> guard(s_mutex);
 
     unsigned char hash[32];
     unsigned char buf[MBEDTLS_MPI_MAX_SIZE];
     size_t size = 0;
 
-    mbedtls_entropy_init(&entropy);
-    mbedtls_ctr_drbg_init(&ctr_drbg);
-    mbedtls_pk_init(&pk);
-    mbedtls_ctr_drbg_seed(&ctr_drbg, mbedtls_entropy_func, &entropy, NULL, 0);
-
-    mbedtls_pk_parse_key(&pk, key.bytes(), key.size() + 1, NULL, 0);
-    mbedtls_md(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), data.bytes(),
-               data.size(), hash);
-    mbedtls_pk_sign(&pk, MBEDTLS_MD_SHA256, hash, 0, buf, &size,
-                    mbedtls_ctr_drbg_random, &ctr_drbg);
-
-    mbedtls_pk_free(&pk);
-    mbedtls_ctr_drbg_free(&ctr_drbg);
-    mbedtls_entropy_free(&entropy);
+    mbedtls_pk_context* pk = _parsed_key(key);
+    mbedtls_ctr_drbg_context* ctr_drbg = _drbg();
+    if (pk && ctr_drbg) {
+        mbedtls_md(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), data.bytes(),
+                   data.size(), hash);
+        mbedtls_pk_sign(pk, MBEDTLS_MD_SHA256, hash, 0, buf, &size,
+                        mbedtls_ctr_drbg_random, ctr_drbg);
+    }
 
     if (size > 0) {
         return Data(buf, size);
@@ -184,33 +298,18 @@ Data MbedTLSCryptoManager::sign_data(Data data, Data key) {
 
 // Cert and key generator
 
-static void _generate_key(mbedtls_pk_context* key) {
-    mbedtls_entropy_context entropy;
-    mbedtls_ctr_drbg_context ctr_drbg;
-
-    mbedtls_entropy_init(&entropy);
-    mbedtls_ctr_drbg_init(&ctr_drbg);
-    mbedtls_ctr_drbg_seed(&ctr_drbg, mbedtls_entropy_func, &entropy, NULL, 0);
-
+static void _generate_key(mbedtls_pk_context* key,
+                          mbedtls_ctr_drbg_context* ctr_drbg) {
     mbedtls_pk_init(key);
 
     mbedtls_pk_setup(key, mbedtls_pk_info_from_type(MBEDTLS_PK_RSA));
     mbedtls_rsa_gen_key(mbedtls_pk_rsa(*key), mbedtls_ctr_drbg_random,
-                        &ctr_drbg, 2048, 65537);
-
-    mbedtls_ctr_drbg_free(&ctr_drbg);
-    mbedtls_entropy_free(&entropy);
+                        ctr_drbg, 2048, 65537);
 }
 
 static void _generate_cert(mbedtls_x509write_cert* cert,
                            mbedtls_pk_context* key) {
-    mbedtls_entropy_context entropy;
-    mbedtls_ctr_drbg_context ctr_drbg;
     mbedtls_mpi serial;
-
-    mbedtls_entropy_init(&entropy);
-    mbedtls_ctr_drbg_init(&ctr_drbg);
-    mbedtls_ctr_drbg_seed(&ctr_drbg, mbedtls_entropy_func, &entropy, NULL, 0);
     mbedtls_mpi_init(&serial);
     mbedtls_mpi_lset(&serial, 1);
 
@@ -227,22 +326,19 @@ static void _generate_cert(mbedtls_x509write_cert* cert,
     mbedtls_x509write_crt_set_serial(cert, &serial);
 
     mbedtls_mpi_free(&serial);
-    mbedtls_ctr_drbg_free(&ctr_drbg);
-    mbedtls_entropy_free(&entropy);
 }
 
 static bool _generate_new_cert_key_pair() {
-    mbedtls_entropy_context entropy;
-    mbedtls_ctr_drbg_context ctr_drbg;
+    std::lock_guard<std::mutex> guard(s_mutex);
 
-    mbedtls_entropy_init(&entropy);
-    mbedtls_ctr_drbg_init(&ctr_drbg);
-    mbedtls_ctr_drbg_seed(&ctr_drbg, mbedtls_entropy_func, &entropy, NULL, 0);
+    mbedtls_ctr_drbg_context* ctr_drbg = _drbg();
+    if (!ctr_drbg)
+        return false;
 
     mbedtls_x509write_cert cert;
     mbedtls_pk_context key;
 
-    _generate_key(&key);
+    _generate_key(&key, ctr_drbg);
     _generate_cert(&cert, &key);
 
     unsigned char tmp[4096];
@@ -255,14 +351,12 @@ static bool _generate_new_cert_key_pair() {
     memset(tmp, 0, 4096);
 
     i = mbedtls_x509write_crt_pem(&cert, tmp, 4096, mbedtls_ctr_drbg_random,
-                                  &ctr_drbg);
+                                  ctr_drbg);
     len = strlen((char*)tmp);
     m_cert = Data(tmp, len);
 
     mbedtls_x509write_crt_free(&cert);
     mbedtls_pk_free(&key);
-    mbedtls_ctr_drbg_free(&ctr_drbg);
-    mbedtls_entropy_free(&entropy);
     return true;
 }
 
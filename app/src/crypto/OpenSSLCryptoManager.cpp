@@ -11,10 +11,63 @@
 #include <openssl/pem.h>
 #include <openssl/evp.h>
 #include <openssl/pkcs12.h>
+#include <map>
+#include <mutex>
 
 static Data m_cert;
 static Data m_key;
 
+// Parsed certs and keys are kept around instead of reading the PEM again
+// on every call, guarded by s_mutex
+static const size_t max_cached_certs = 8;
+
+static std::mutex s_mutex;
+static std::map<std::string, X509*> s_certs;
+static std::string s_key_pem;
+static EVP_PKEY* s_key = nullptr;
+
+static X509* _parsed_cert(const Data& cert) {
+    std::string pem((const char*)cert.bytes(), cert.size());
+    auto it = s_certs.find(pem);
+    if (it != s_certs.end())
+        return it->second;
+
+    BIO* bio = BIO_new_mem_buf(pem.data(), (int)pem.size());
+    X509* x509 = PEM_read_bio_X509(bio, NULL, NULL, NULL);
+    BIO_free(bio);
+
+    if (!x509)
+        return nullptr;
+
+    if (s_certs.size() >= max_cached_certs) {
+        for (auto& [pem, cached] : s_certs)
+            X509_free(cached);
+        s_certs.clear();
+    }
+    s_certs[pem] = x509;
+    return x509;
+}
+
+static EVP_PKEY* _parsed_key(const Data& key) {
+    std::string pem((const char*)key.bytes(), key.size());
+    if (s_key && pem == s_key_pem)
+        return s_key;
+
+    BIO* bio = BIO_new_mem_buf(pem.data(), (int)pem.size());
+    EVP_PKEY* pkey = PEM_read_bio_PrivateKey(bio, NULL, NULL, NULL);
+    BIO_free(bio);
+
+    if (!pkey)
+        return nullptr;
+
+    // Only one identity is in use at a time
+    if (s_key)
+        EVP_PKEY_free(s_key);
+    s_key = pkey;
+    s_key_pem = pem;
+    return s_key;
+}
+
 static const int NUM_BITS = 2048;
 static const int SERIAL = 0;
 static const int NUM_YEARS = 10;
@@ -27,8 +80,8 @@ bool OpenSSLCryptoManager::load_cert_key_pair() {
         Data key = Data::read_from_file(Settings::instance().key_dir() + "/" + KEY_FILE_NAME);
         
         if (!cert.is_empty() && !key.is_empty()) {
-            m_cert = cert;
-            m_key = key;
+            m_cert = std::move(cert);
+            m_key = std::move(key);
             return true;
         }
         return false;
@@ -62,73 +115,111 @@ Data OpenSSLCryptoManager::key_data() {
     return m_key;
 }
 
-Data OpenSSLCryptoManager::SHA1_hash_data(Data data) {
+Data OpenSSLCryptoManager::SHA1_hash_data(const Data& data) {
     unsigned char sha1[20];
     SHA1(data.bytes(), data.size(), sha1);
     return Data(sha1, sizeof(sha1));
 }
 
-Data OpenSSLCryptoManager::SHA256_hash_data(Data data) {
+Data OpenSSLCryptoManager::SHA256_hash_data(const Data& data) {
     unsigned char sha256[32];
     SHA256(data.bytes(), data.size(), sha256);
     return Data(sha256, sizeof(sha256));
 }
 
-Data OpenSSLCryptoManager::create_AES_key_from_salt_SHA1(Data salted_pin) {
+Data OpenSSLCryptoManager::create_AES_key_from_salt_SHA1(const Data& salted_pin) {
     return SHA1_hash_data(salted_pin).subdata(0, 16);
 }
 
-Data OpenSSLCryptoManager::create_AES_key_from_salt_SHA256(Data salted_pin) {
+Data OpenSSLCryptoManager::create_AES_key_from_salt_SHA256(const Data& salted_pin) {
     return SHA256_hash_data(salted_pin).subdata(0, 16);
 }
 
-static int get_encrypt_size(Data data) {
+static int get_encrypt_size(const Data& data) {
     // the size is the length of the data ceiling to the nearest 16 bytes
     return (((int)data.size() + 15) / 16) * 16;
 }
 
-Data OpenSSLCryptoManager::aes_encrypt(Data data, Data key) {
+// AES-128-ECB over whole blocks through EVP, which uses AES-NI or the ARMv8
+// crypto extensions when available. in and out may be the same buffer.
+static bool _aes_ecb(const Data& key, bool encrypt, const unsigned char* in,
+                     unsigned char* out, int size) {
+    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+    int len = 0, final_len = 0;
+    bool result =
+        ctx &&
+        EVP_CipherInit_ex(ctx, EVP_aes_128_ecb(), NULL, key.bytes(), NULL,
+                          encrypt ? 1 : 0) == 1 &&
+        EVP_CIPHER_CTX_set_padding(ctx, 0) == 1 &&
+        EVP_CipherUpdate(ctx, out, &len, in, size) == 1 &&
+        EVP_CipherFinal_ex(ctx, out + len, &final_len) == 1;
+    EVP_CIPHER_CTX_free(ctx);
+    return result;
+}
+
+Data OpenSSLCryptoManager::aes_encrypt(const Data& data, const Data& key) {
+    // Zero padded up to the block size, encrypted in place
+    int size = get_encrypt_size(data);
+    Data encrypted_data(size);
+    unsigned char* buffer = encrypted_data.bytes();
+    memcpy(buffer, data.bytes(), data.size());
+
+    if (!_aes_ecb(key, true, buffer, buffer, size))
+        return Data();
+    return encrypted_data;
+}
+
+Data OpenSSLCryptoManager::aes_decrypt(const Data& data, const Data& key) {
+    // A trailing partial block is left zeroed
+    Data decrypted_data(data.size());
+    int size = (int)data.size() & ~15;
+
+    if (!_aes_ecb(key, false, data.bytes(), decrypted_data.bytes(), size))
+        return Data();
+    return decrypted_data;
+}
+
+Data OpenSSLCryptoManager::aes_encrypt_reference(const Data& data, const Data& key) {
     AES_KEY aes_key;
     AES_set_encrypt_key((unsigned char*)key.bytes(), 128, &aes_key);
+
+    // Zero padded up to the block size, encrypted in place
     int size = get_encrypt_size(data);
-    unsigned char* buffer = (unsigned char*)malloc(size);
-    unsigned char* block_rounded_buffer = (unsigned char*)calloc(1, size);
-    memcpy(block_rounded_buffer, data.bytes(), data.size());
+    Data encrypted_data(size);
+    unsigned char* buffer = encrypted_data.bytes();
+    memcpy(buffer, data.bytes(), data.size());
     
     // AES_encrypt only encrypts the first 16 bytes so iterate the entire buffer
     int block_offset = 0;
     while (block_offset < size) {
-        AES_encrypt(block_rounded_buffer + block_offset, buffer + block_offset, &aes_key);
+        AES_encrypt(buffer + block_offset, buffer + block_offset, &aes_key);
         block_offset += 16;
     }
     
-    Data encrypted_data = Data((char*)buffer, size);
-    free(buffer);
-    free(block_rounded_buffer);
     return encrypted_data;
 }
 
-Data OpenSSLCryptoManager::aes_decrypt(Data data, Data key) {
+Data OpenSSLCryptoManager::aes_decrypt_reference(const Data& data, const Data& key) {
     AES_KEY aes_key;
     AES_set_decrypt_key(key.bytes(), 128, &aes_key);
-    unsigned char* buffer = (unsigned char*)malloc(data.size());
+
+    Data decrypted_data(data.size());
+    unsigned char* buffer = decrypted_data.bytes();
     
     // AES_decrypt only decrypts the first 16 bytes so iterate the entire buffer
     int block_offset = 0;
-    while (block_offset < data.size()) {
+    while (block_offset + 16 <= data.size()) {
         AES_decrypt(data.bytes() + block_offset, buffer + block_offset, &aes_key);
         block_offset += 16;
     }
     
-    Data decrypted_data = Data(buffer, data.size());
-    free(buffer);
     return decrypted_data;
 }
 
-Data OpenSSLCryptoManager::signature(Data cert) {
-    BIO* bio = BIO_new_mem_buf(cert.bytes(), cert.size());
-    X509* x509 = PEM_read_bio_X509(bio, NULL, NULL, NULL);
-    
+Data OpenSSLCryptoManager::signature(const Data& cert) {
+    std::lock_guard<std::mutex> guard(s_mutex);
+
+    X509* x509 = _parsed_cert(cert);
     if (!x509) {
 //        Logger::error("Crypto", "Unable to parse certificate in memory!");
         return Data();
@@ -144,17 +235,13 @@ Data OpenSSLCryptoManager::signature(Data cert) {
     X509_get0_signature(&asn_signature, NULL, x509);
 #endif
     
-    Data sig = Data(asn_signature->data, asn_signature->length);
-    X509_free(x509);
-    return sig;
+    return Data(asn_signature->data, asn_signature->length);
 }
 
-bool OpenSSLCryptoManager::verify_signature(Data data, Data signature, Data cert) {
-    BIO* bio = BIO_new_mem_buf(cert.bytes(), cert.size());
-    X509* x509 = PEM_read_bio_X509(bio, NULL, NULL, NULL);
-    
-    BIO_free(bio);
-    
+bool OpenSSLCryptoManager::verify_signature(const Data& data, const Data& signature, const Data& cert) {
+    std::lock_guard<std::mutex> guard(s_mutex);
+
+    X509* x509 = _parsed_cert(cert);
     if (!x509) {
 //        Logger::error("Crypto", "Unable to parse certificate in memory...");
         return false;
@@ -167,18 +254,15 @@ bool OpenSSLCryptoManager::verify_signature(Data data, Data signature, Data cert
     EVP_DigestVerifyUpdate(mdctx, data.bytes(), data.size());
     int result = EVP_DigestVerifyFinal(mdctx, signature.bytes(), signature.size());
     
-    X509_free(x509);
     EVP_PKEY_free(pub_key);
     EVP_MD_CTX_destroy(mdctx);
     return result > 0;
 }
 
-Data OpenSSLCryptoManager::sign_data(Data data, Data key) {
-    BIO* bio = BIO_new_mem_buf(key.bytes(), key.size());
-    EVP_PKEY* pkey = PEM_read_bio_PrivateKey(bio, NULL, NULL, NULL);
-    
-    BIO_free(bio);
-    
+Data OpenSSLCryptoManager::sign_data(const Data& data, const Data& key) {
+    std::lock_guard<std::mutex> guard(s_mutex);
+
+    EVP_PKEY* pkey = _parsed_key(key);
     if (!pkey) {
 //        Logger::error("Crypto", "Unable to parse private key in memory...");
         return Data();
@@ -189,21 +273,17 @@ Data OpenSSLCryptoManager::sign_data(Data data, Data key) {
     EVP_DigestSignUpdate(mdctx, data.bytes(), data.size());
     size_t slen;
     EVP_DigestSignFinal(mdctx, NULL, &slen);
-    unsigned char* signature = (unsigned char*)malloc(slen);
-    int result = EVP_DigestSignFinal(mdctx, signature, &slen);
+    Data signed_data(slen);
+    int result = EVP_DigestSignFinal(mdctx, signed_data.bytes(), &slen);
     
-    EVP_PKEY_free(pkey);
     EVP_MD_CTX_destroy(mdctx);
     
     if (result <= 0) {
-        free(signature);
 //        Logger::error("Crypto", "Unable to sign data...");
-        Data();
+        return Data();
     }
     
-    Data signed_data = Data(signature, slen);
-    free(signature);
-    return signed_data;
+    return signed_data.subdata(0, slen);
 }
 
 // Cert and key generator
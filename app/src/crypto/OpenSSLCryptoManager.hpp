@@ -15,14 +15,18 @@ public:
     static Data cert_data();
     static Data key_data();
     
-    static Data SHA1_hash_data(Data data);
-    static Data SHA256_hash_data(Data data);
-    static Data create_AES_key_from_salt_SHA1(Data salted_pin);
-    static Data create_AES_key_from_salt_SHA256(Data salted_pin);
-    static Data aes_encrypt(Data data, Data key);
-    static Data aes_decrypt(Data data, Data key);
+    static Data SHA1_hash_data(const Data& data);
+    static Data SHA256_hash_data(const Data& data);
+    static Data create_AES_key_from_salt_SHA1(const Data& salted_pin);
+    static Data create_AES_key_from_salt_SHA256(const Data& salted_pin);
+    static Data aes_encrypt(const Data& data, const Data& key);
+    static Data aes_decrypt(const Data& data, const Data& key);
+    // Block by block versions aes_encrypt/aes_decrypt must stay equal to,
+    // checked by the crypto_aes_equivalence test (app/tools/crypto_bench.cpp)
+    static Data aes_encrypt_reference(const Data& data, const Data& key);
+    static Data aes_decrypt_reference(const Data& data, const Data& key);
     
-    static Data signature(Data cert);
-    static bool verify_signature(Data data, Data signature, Data cert);
-    static Data sign_data(Data data, Data key);
+    static Data signature(const Data& cert);
+    static bool verify_signature(const Data& data, const Data& signature, const Data& cert);
+    static Data sign_data(const Data& data, const Data& key);
 };
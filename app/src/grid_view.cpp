@@ -6,6 +6,16 @@
 //
 
 #include "grid_view.hpp"
+#include <algorithm>
+#include <cmath>
+
+// Rows past the screen edge that may still load ahead of scrolling. A
+// virtualized grid keeps this many rows alive on each side of the screen.
+static const int prefetch_rows = 2;
+// Space between cells and between rows
+static const float grid_spacing = 12;
+// Row height used by a virtualized grid before its first layout
+static const float default_row_height = 212;
 
 GridView::GridView() : Box(Axis::COLUMN), columls(7) {}
 
@@ -14,12 +24,12 @@ GridView::GridView(int columns) : Box(Axis::COLUMN), columls(columns) {}
 void GridView::addView(View* view) {
     if (getChildren().size() % columls == 0) {
         if (lastContainer)
-            lastContainer->setPaddingBottom(12);
+            lastContainer->setPaddingBottom(grid_spacing);
 
         lastContainer = new Box(Axis::ROW);
         Box::addView(lastContainer);
     } else if (lastView) {
-        lastView->setMarginRight(12);
+        lastView->setMarginRight(grid_spacing);
     }
     lastContainer->addView(view);
     children.push_back(view);
@@ -31,6 +41,149 @@ void GridView::clearViews(bool free) {
     children.clear();
     lastContainer = nullptr;
     lastView = nullptr;
+    itemCount = 0;
+    firstRow = 0;
+}
+
+void GridView::setDataSource(GridDataSource* dataSource) {
+    clearViews();
+    this->dataSource = dataSource;
+    reloadData();
+}
+
+void GridView::reloadData() {
+    if (!dataSource)
+        return;
+
+    itemCount = dataSource->numberOfItems();
+    size_t rows = (itemCount + columls - 1) / columls;
+    resizeRowPool(std::min(rows, rowCapacity()));
+
+    size_t pool = Box::getChildren().size();
+    firstRow = std::min(firstRow, rows - pool);
+    for (size_t i = 0; i < pool; i++)
+        bindRow((Box*)Box::getChildren()[i], firstRow + i);
+
+    updateVirtualLayout();
+}
+
+size_t GridView::rowCapacity() {
+    float rowHeight = default_row_height;
+    if (!Box::getChildren().empty() && Box::getChildren().front()->getHeight() > 0)
+        rowHeight = Box::getChildren().front()->getHeight();
+
+    return (size_t)std::ceil(Application::contentHeight / rowHeight) + 1 +
+           2 * prefetch_rows;
+}
+
+void GridView::resizeRowPool(size_t rows) {
+    while (Box::getChildren().size() < rows) {
+        Box* row = new Box(Axis::ROW);
+        row->setPaddingBottom(grid_spacing);
+        for (int i = 0; i < columls; i++) {
+            View* view = dataSource->createItem();
+            if (i + 1 < columls)
+                view->setMarginRight(grid_spacing);
+            row->addView(view);
+        }
+        Box::addView(row);
+    }
+
+    while (Box::getChildren().size() > rows) {
+        View* row = Box::getChildren().back();
+
+        View* focus = Application::getCurrentFocus();
+        for (View* view = focus; view; view = view->getParent()) {
+            if (view == row) {
+                Application::giveFocus(this);
+                break;
+            }
+        }
+
+        Box::removeView(row, true);
+    }
+}
+
+void GridView::bindRow(Box* row, size_t rowIndex) {
+    for (int i = 0; i < columls; i++) {
+        View* view = row->getChildren()[i];
+        size_t index = rowIndex * columls + i;
+
+        if (index < itemCount) {
+            view->setVisibility(Visibility::VISIBLE);
+            dataSource->bindItem(view, index);
+        } else {
+            view->setVisibility(Visibility::GONE);
+        }
+    }
+}
+
+void GridView::updateVirtualLayout() {
+    std::vector<View*>& rows = Box::getChildren();
+    size_t totalRows = (itemCount + columls - 1) / columls;
+    float rowHeight = rows.empty() || rows.front()->getHeight() <= 0
+                          ? default_row_height
+                          : rows.front()->getHeight();
+
+    // Rows that are not materialized are stood in for by padding
+    setPaddingTop(firstRow * rowHeight);
+    setPaddingBottom((totalRows - firstRow - rows.size()) * rowHeight);
+
+    // Rows get moved around, keep their indices in line for navigation
+    children.clear();
+    for (size_t i = 0; i < rows.size(); i++) {
+        *((size_t*)rows[i]->getParentUserData()) = i;
+        for (View* view : rows[i]->getChildren())
+            children.push_back(view);
+    }
+
+    // Force the next prefetch pass
+    prefetchCount = (size_t)-1;
+}
+
+void GridView::updateVirtualRows() {
+    std::vector<View*>& rows = Box::getChildren();
+    if (!dataSource || rows.empty())
+        return;
+
+    size_t totalRows = (itemCount + columls - 1) / columls;
+    if (rows.size() < std::min(totalRows, rowCapacity())) {
+        reloadData();
+        return;
+    }
+
+    float rowHeight = std::max(rows.front()->getHeight(), 1.0f);
+    int visibleRow = (int)std::floor(-getY() / rowHeight);
+    size_t first = (size_t)std::clamp(visibleRow - prefetch_rows, 0,
+                                      (int)(totalRows - rows.size()));
+    if (first == firstRow)
+        return;
+
+    // Recycle the rows that scrolled out at the other end
+    size_t shift = first > firstRow ? first - firstRow : firstRow - first;
+    if (shift >= rows.size()) {
+        firstRow = first;
+        for (size_t i = 0; i < rows.size(); i++)
+            bindRow((Box*)rows[i], firstRow + i);
+    } else if (first > firstRow) {
+        for (size_t i = 0; i < shift; i++) {
+            Box* row = (Box*)rows.front();
+            Box::removeView(row, false);
+            Box::addView(row);
+            bindRow(row, firstRow + rows.size() + i);
+        }
+        firstRow = first;
+    } else {
+        for (size_t i = 0; i < shift; i++) {
+            Box* row = (Box*)rows.back();
+            Box::removeView(row, false);
+            Box::addView(row, 0);
+            bindRow(row, firstRow - i - 1);
+        }
+        firstRow = first;
+    }
+
+    updateVirtualLayout();
 }
 
 View* GridView::getParentNavigationDecision(View* from, View* newFocus,
@@ -48,9 +201,18 @@ View* GridView::getParentNavigationDecision(View* from, View* newFocus,
             currentFocusIndex >= source->getParent()->getChildren().size())
             return Box::getParentNavigationDecision(from, newFocus, direction);
 
-        if (newFocus->getParent()->getChildren().size() <= currentFocusIndex) {
-            newFocus = newFocus->getParent()->getChildren()
-                           [newFocus->getParent()->getChildren().size() - 1];
+        // The last row of a virtualized grid hides its unused cells
+        std::vector<View*>& siblings = newFocus->getParent()->getChildren();
+        size_t items = 0;
+        while (items < siblings.size() &&
+               siblings[items]->getVisibility() == Visibility::VISIBLE)
+            items++;
+
+        if (items == 0)
+            return Box::getParentNavigationDecision(from, newFocus, direction);
+
+        if (items <= currentFocusIndex) {
+            newFocus = siblings[items - 1];
             return Box::getParentNavigationDecision(from, newFocus, direction);
         }
 
@@ -95,3 +257,62 @@ int GridView::getItemsInRow(int row) {
 }
 
 std::vector<View*>& GridView::getChildren() { return this->children; }
+
+void GridView::draw(NVGcontext* vg, float x, float y, float width,
+                    float height, Style style, FrameContext* ctx) {
+    updateVirtualRows();
+    updatePrefetchPriorities();
+    Box::draw(vg, x, y, width, height, style, ctx);
+}
+
+void GridView::updatePrefetchPriorities() {
+    std::vector<View*>& rows = Box::getChildren();
+    if (rows.empty())
+        return;
+
+    int focus = -1;
+    for (View* view = Application::getCurrentFocus(); view;
+         view = view->getParent()) {
+        if (view->getParent() && view->getParent()->getParent() == this) {
+            focus = getItemIndex(view);
+            break;
+        }
+    }
+
+    // Only recompute when something moved
+    float offset = rows.front()->getY();
+    if (focus == prefetchFocus && offset == prefetchOffset &&
+        children.size() == prefetchCount)
+        return;
+
+    prefetchFocus = focus;
+    prefetchOffset = offset;
+    prefetchCount = children.size();
+
+    // Rows outside the screen go after every visible cell, nearest first.
+    // Within a band, cells closer to the focus go first.
+    for (size_t i = 0; i < children.size(); i++) {
+        auto* item = dynamic_cast<GridPrefetchable*>(children[i]);
+        if (!item || children[i]->getVisibility() != Visibility::VISIBLE)
+            continue;
+
+        View* row = rows[i / columls];
+        float top = row->getY();
+        float rowHeight = std::max(row->getHeight(), 1.0f);
+
+        int rowsAway = 0;
+        if (top + rowHeight < 0)
+            rowsAway = (int)std::ceil(-(top + rowHeight) / rowHeight);
+        else if (top > Application::contentHeight)
+            rowsAway =
+                (int)std::ceil((top - Application::contentHeight) / rowHeight);
+
+        if (rowsAway > prefetch_rows) {
+            item->setPrefetchPriority(-1);
+            continue;
+        }
+
+        int distance = focus < 0 ? (int)i : std::abs((int)i - focus);
+        item->setPrefetchPriority(rowsAway * (int)children.size() + distance);
+    }
+}
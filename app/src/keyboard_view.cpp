@@ -28,7 +28,7 @@ short KeyboardCodes[_VK_KEY_MAX]
 std::chrono::high_resolution_clock::time_point rumbleLastButtonClicked;
 bool rumblingActive = false;
 
-bool keysState[_VK_KEY_MAX];
+std::bitset<_VK_KEY_MAX> keysState;
 bool keysStateInited = false;
 brls::InputManager* inputManager = nullptr;
 
@@ -281,10 +281,7 @@ void KeyboardView::draw(NVGcontext* vg, float x, float y, float width,
 
 KeyboardState KeyboardView::getKeyboardState() {
     KeyboardState state{};
-
-    for (int i = 0; i < _VK_KEY_MAX; i++)
-        state.keys[i] = keysState[i];
-
+    state.keys = keysState;
     return state;
 }
 
@@ -19,6 +19,7 @@
 
 #include "Settings.hpp"
 #include "client.h"
+#include "ClientIdentity.hpp"
 #include "CryptoManager.hpp"
 #include "errors.h"
 #include "http.h"
@@ -28,6 +29,7 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
+#include <mutex>
 #include <sstream>
 
 #define CHANNEL_COUNT_STEREO 2
@@ -105,6 +107,9 @@ static int load_serverinfo(PSERVER_DATA server, bool https) {
     if (xml_search(data, "mac", &server->mac) != GS_OK)
         goto cleanup;
 
+    // Only used to key local caches, so older hosts may omit it
+    xml_search(data, "uniqueid", &server->uniqueid);
+
     // These fields are present on all version of GFE that this client
     // supports
     if (currentGameText.empty() || pairedText.empty() ||
@@ -133,7 +138,7 @@ cleanup:
     return ret;
 }
 
-static int load_server_status(PSERVER_DATA server) {
+static int load_server_status(PSERVER_DATA server, bool https) {
     int ret = GS_INVALID;
     int i;
 
@@ -149,7 +154,7 @@ static int load_server_status(PSERVER_DATA server) {
     // make another request over HTTP if the HTTPS request fails. We can't just use HTTP
     // for everything because it doesn't accurately tell us if we're paired.
     ret = GS_INVALID;
-    for (i = 0; i < 2 && ret != GS_OK; i++) {
+    for (i = https ? 0 : 1; i < 2 && ret != GS_OK; i++) {
         ret = load_serverinfo(server, i == 0);
     }
 
@@ -170,7 +175,9 @@ static int load_server_status(PSERVER_DATA server) {
     return ret;
 }
 
-static std::string _gs_error = "";
+// Requests run on many worker threads at once, each reads back the error
+// of its own last call
+static thread_local std::string _gs_error = "";
 
 void gs_set_error(std::string error) { _gs_error = error; }
 
@@ -231,6 +238,11 @@ int gs_pair(PSERVER_DATA server, char* pin) {
         return GS_WRONG_STATE;
     }
 
+    if (!ClientIdentity::instance().wait()) {
+        gs_set_error("Failed to generate client certificate");
+        return GS_FAILED;
+    }
+
     if (server->currentGame != 0) {
         gs_set_error(
             "The computer is currently in a game. You must close the game "
@@ -319,9 +331,11 @@ int gs_pair(PSERVER_DATA server, char* pin) {
 
     Data clientSecret = Data::random_bytes(16);
     Data challengeRespHashInput =
-        serverChallenge
+        DataBuilder()
+            .append(serverChallenge)
             .append(CryptoManager::signature(CryptoManager::cert_data()))
-            .append(clientSecret);
+            .append(clientSecret)
+            .build();
 
     Data challengeRespHash;
 
@@ -372,9 +386,11 @@ int gs_pair(PSERVER_DATA server, char* pin) {
     }
 
     Data serverChallengeRespHashInput =
-        randomChallenge
+        DataBuilder()
+            .append(randomChallenge)
             .append(CryptoManager::signature(plainCert.hex_to_bytes()))
-            .append(serverSecret);
+            .append(serverSecret)
+            .build();
     Data serverChallengeRespHash;
 
     if (server->serverMajorVersion >= 7) {
@@ -454,7 +470,7 @@ int gs_app_boxart(PSERVER_DATA server, int app_id, Data* out) {
     if (http_request(url, &data, HTTPRequestTimeoutMedium) != GS_OK) {
         ret = GS_IO_ERROR;
     } else {
-        *out = data;
+        *out = std::move(data);
     }
     return ret;
 }
@@ -573,16 +589,20 @@ int gs_init(PSERVER_DATA server, const std::string address) {
         httpPort = atoi(seglist[1].c_str());
     }
     
-    if (!CryptoManager::load_cert_key_pair()) {
-        brls::Logger::info("Client: No certs, generate new...");
-
-        if (!CryptoManager::generate_new_cert_key_pair()) {
-            brls::Logger::info("Client: Failed to generate certs...");
-            return GS_FAILED;
-        }
+    {
+        // Hosts may be probed from several threads at once
+        static std::mutex init_mutex;
+        std::lock_guard<std::mutex> guard(init_mutex);
+        http_init(Settings::instance().key_dir());
     }
 
-    http_init(Settings::instance().key_dir());
+    // A host cannot know an identity that is still being generated, so
+    // skip the HTTPS probe instead of waiting for it
+    bool https = !ClientIdentity::instance().is_generating();
+    if (https && !ClientIdentity::instance().wait()) {
+        gs_set_error("Failed to generate client certificate");
+        return GS_FAILED;
+    }
 
     LiInitializeServerInformation(&server->serverInfo);
     server->address = seglist[0];
@@ -590,7 +610,7 @@ int gs_init(PSERVER_DATA server, const std::string address) {
     server->httpPort = httpPort;
     server->httpsPort = 0; /* Populated by load_server_status() */
 
-    int result = load_server_status(server);
+    int result = load_server_status(server, https);
     server->serverInfo.serverInfoAppVersion =
         server->serverInfoAppVersion.c_str();
     server->serverInfo.serverInfoGfeVersion =
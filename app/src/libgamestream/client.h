@@ -39,6 +39,7 @@ typedef struct _SERVER_DATA {
     int serverMajorVersion;
     std::string gsVersion;
     std::string hostname;
+    std::string uniqueid;
     SERVER_INFORMATION serverInfo;
     unsigned short httpPort;
     unsigned short httpsPort;
@@ -18,117 +18,245 @@
  */
 
 #include "http.h"
+#include "ClientIdentity.hpp"
 #include "CryptoManager.hpp"
 #include "client.h"
 #include "errors.h"
 #include <borealis/core/logger.hpp>
 
+#include <algorithm>
+#include <atomic>
 #include <curl/curl.h>
+#include <mutex>
 #include <stdbool.h>
 #include <string.h>
 #include <stdio.h>
+#include <vector>
 
-static CURL* curl;
+// Responses above this size are not kept around for reuse
+#define HTTP_ARENA_MAX_SIZE (4 * 1024 * 1024)
 
-struct HTTP_DATA {
-    char* memory;
-    size_t size;
+static bool initialized = false;
+static std::string certificate_file_path;
+static std::string key_file_path;
+
+// Easy handles must not be shared between threads, so every thread that
+// talks to a host gets its own. The fields are guarded by handles_mutex,
+// http_cleanup frees the handles of other threads.
+struct ThreadHandle {
+    CURL* curl = nullptr;
+    // A request is running, http_cleanup leaves the handle to its thread
+    bool busy = false;
+    bool stale = false;
+
+    ~ThreadHandle();
+    void release();
+};
+
+static std::mutex handles_mutex;
+static std::vector<ThreadHandle*> handles;
+static thread_local ThreadHandle thread_handle;
+
+// Last response handed out on this thread. Once the caller drops it, its
+// buffer backs the next response instead of being freed and reallocated.
+static thread_local Data response_arena;
+
+// Bumped by http_cleanup. Other threads notice on their next request and
+// let go of their arena.
+static std::atomic<unsigned> cleanup_generation{0};
+static thread_local unsigned thread_generation = 0;
+
+// Called with handles_mutex held
+void ThreadHandle::release() {
+    if (!curl)
+        return;
+
+    curl_easy_cleanup(curl);
+    curl = nullptr;
+    stale = false;
+    handles.erase(std::remove(handles.begin(), handles.end(), this),
+                  handles.end());
+}
+
+ThreadHandle::~ThreadHandle() {
+    std::lock_guard<std::mutex> guard(handles_mutex);
+    release();
+}
+
+struct HTTP_RESPONSE {
+    CURL* handle;
+    DataBuilder body;
+    bool sized;
 };
 
 static size_t _write_curl(void* contents, size_t size, size_t nmemb,
                           void* userp) {
     size_t realsize = size * nmemb;
-    HTTP_DATA* mem = (HTTP_DATA*)userp;
+    HTTP_RESPONSE* response = (HTTP_RESPONSE*)userp;
 
-    mem->memory = (char*)realloc(mem->memory, mem->size + realsize + 1);
-    if (mem->memory == NULL)
-        return 0;
+    // Headers are complete by the first body chunk, so size the buffer once
+    // from Content-Length instead of growing it chunk by chunk
+    if (!response->sized) {
+        response->sized = true;
+#if LIBCURL_VERSION_NUM >= 0x073700
+        curl_off_t length = -1;
+        curl_easy_getinfo(response->handle,
+                          CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length);
+#else
+        double length = -1;
+        curl_easy_getinfo(response->handle, CURLINFO_CONTENT_LENGTH_DOWNLOAD,
+                          &length);
+#endif
+        // A bogus Content-Length must not allocate more than the arena
+        // keeps, bigger bodies grow as they arrive
+        if (length > 0)
+            response->body.reserve(
+                std::min((size_t)length, (size_t)HTTP_ARENA_MAX_SIZE));
+    }
 
-    memcpy(&(mem->memory[mem->size]), contents, realsize);
-    mem->size += realsize;
-    mem->memory[mem->size] = 0;
+    response->body.append(contents, realsize);
     return realsize;
 }
 
 int http_init(const std::string key_directory) {
-    if (!curl) {
+    std::lock_guard<std::mutex> guard(handles_mutex);
+
+    if (initialized)
+        return GS_OK;
+
 #if LIBCURL_VERSION_NUM >= 0x075600
 #ifdef USE_OPENSSL_CRYPTO
-        curl_global_sslset(CURLSSLBACKEND_OPENSSL, NULL, NULL);
+    curl_global_sslset(CURLSSLBACKEND_OPENSSL, NULL, NULL);
 #elif USE_MBEDTLS_CRYPTO
-        curl_global_sslset(CURLSSLBACKEND_MBEDTLS, NULL, NULL);
+    curl_global_sslset(CURLSSLBACKEND_MBEDTLS, NULL, NULL);
 #endif
 #endif
-        curl_global_init(CURL_GLOBAL_ALL);
-        brls::Logger::info("Curl: {}", curl_version());
-    } else {
-        return GS_OK;
+    curl_global_init(CURL_GLOBAL_ALL);
+    brls::Logger::info("Curl: {}", curl_version());
+
+    certificate_file_path = key_directory + "/" + CERTIFICATE_FILE_NAME;
+    key_file_path = key_directory + "/" + KEY_FILE_NAME;
+    initialized = true;
+
+    return GS_OK;
+}
+
+// Marks the handle busy until http_release_handle
+static CURL* http_handle() {
+    unsigned generation = cleanup_generation;
+    if (thread_generation != generation) {
+        thread_generation = generation;
+        response_arena = Data();
     }
 
-    curl = curl_easy_init();
+    std::lock_guard<std::mutex> guard(handles_mutex);
+    if (thread_handle.curl) {
+        thread_handle.busy = true;
+        return thread_handle.curl;
+    }
 
+    CURL* curl = curl_easy_init();
     if (!curl)
-        return GS_FAILED;
-
-    std::string certificateFilePath = key_directory + "/" + CERTIFICATE_FILE_NAME;
-    std::string keyFilePath = key_directory + "/" + KEY_FILE_NAME;
+        return nullptr;
 
     curl_easy_setopt(curl, CURLOPT_VERBOSE, 1L);
     curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
     curl_easy_setopt(curl, CURLOPT_SSLENGINE_DEFAULT, 1L);
     curl_easy_setopt(curl, CURLOPT_SSLCERTTYPE, "PEM");
-    curl_easy_setopt(curl, CURLOPT_SSLCERT, certificateFilePath.c_str());
+    curl_easy_setopt(curl, CURLOPT_SSLCERT, certificate_file_path.c_str());
     curl_easy_setopt(curl, CURLOPT_SSLKEYTYPE, "PEM");
-    curl_easy_setopt(curl, CURLOPT_SSLKEY, keyFilePath.c_str());
+    curl_easy_setopt(curl, CURLOPT_SSLKEY, key_file_path.c_str());
     curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, _write_curl);
     curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
     curl_easy_setopt(curl, CURLOPT_SSL_SESSIONID_CACHE, 0L);
 
-    return GS_OK;
+    thread_handle.curl = curl;
+    thread_handle.busy = true;
+    handles.push_back(&thread_handle);
+    return curl;
+}
+
+static void http_release_handle() {
+    std::lock_guard<std::mutex> guard(handles_mutex);
+    thread_handle.busy = false;
+    // http_cleanup ran during the request
+    if (thread_handle.stale)
+        thread_handle.release();
 }
 
 int http_request(const std::string url, Data* data,
                  HTTPRequestTimeout timeout) {
     brls::Logger::info("Curl: Request:\n{}", url.c_str());
 
-    HTTP_DATA* http_data = (HTTP_DATA*)malloc(sizeof(HTTP_DATA));
-    http_data->memory = (char*)malloc(1);
-    http_data->size = 0;
+    // Drop the caller's previous response first so its buffer can be reused
+    *data = Data();
+
+    // HTTPS requests present the client certificate
+    if (url.rfind("https", 0) == 0 && !ClientIdentity::instance().wait()) {
+        gs_set_error("Failed to generate client certificate");
+        return GS_FAILED;
+    }
 
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, http_data);
+    CURL* curl = http_handle();
+    if (!curl) {
+        gs_set_error("Curl: Failed to create a handle");
+        return GS_FAILED;
+    }
+
+    HTTP_RESPONSE response;
+    response.handle = curl;
+    response.sized = false;
+    response.body.recycle(std::move(response_arena));
+
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
     curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
     curl_easy_setopt(curl, CURLOPT_TIMEOUT, timeout);
 
     CURLcode res = curl_easy_perform(curl);
+    http_release_handle();
 
     if (res != CURLE_OK) {
         gs_set_error(curl_easy_strerror(res));
         brls::Logger::error("Curl: error: {}", gs_error().c_str());
-        free(http_data->memory);
-        free(http_data);
+        Data partial = response.body.build();
+        if (partial.size() <= HTTP_ARENA_MAX_SIZE)
+            response_arena = partial;
         return GS_FAILED;
-    } else if (http_data->memory == NULL) {
-        brls::Logger::error("Curl: memory = NULL");
-        free(http_data->memory);
-        free(http_data);
-        return GS_OUT_OF_MEMORY;
     }
 
-    *data = Data(http_data->memory, http_data->size);
+    *data = response.body.build();
+
+    if (data->size() <= HTTP_ARENA_MAX_SIZE)
+        response_arena = *data;
 
-    if (http_data->size > 3000) {
+    if (data->size() > 3000) {
         brls::Logger::info("Curl: Response: Ok");
     } else {
-        brls::Logger::info("Curl: Response:\n{}", http_data->memory);
+        brls::Logger::info("Curl: Response:\n{}", (char*)data->bytes());
     }
 
-    free(http_data->memory);
-    free(http_data);
     return GS_OK;
 }
 
 void http_cleanup() {
-    curl_easy_cleanup(curl);
-    curl_global_cleanup();
+    std::lock_guard<std::mutex> guard(handles_mutex);
+
+    bool busy = false;
+    for (ThreadHandle* handle : std::vector<ThreadHandle*>(handles)) {
+        if (handle->busy) {
+            handle->stale = true;
+            busy = true;
+        } else {
+            handle->release();
+        }
+    }
+    response_arena = Data();
+    cleanup_generation++;
+
+    // curl must stay initialized for the requests still running
+    if (initialized && !busy) {
+        curl_global_cleanup();
+        initialized = false;
+    }
 }
@@ -28,3 +28,4 @@ enum HTTPRequestTimeout : long {
 
 int http_init(const std::string key_directory);
 int http_request(const std::string url, Data* data, HTTPRequestTimeout timeout);
+void http_cleanup();
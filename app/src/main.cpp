@@ -22,9 +22,14 @@
 #include "main_tabs_view.hpp"
 #include "settings_tab.hpp"
 
+#include "AVFrameHolder.hpp"
+#include "BoxArtManager.hpp"
+#include "ClientIdentity.hpp"
 #include "DiscoverManager.hpp"
 #include "MoonlightSession.hpp"
+#include "StartupTrace.hpp"
 #include "SwitchMoonlightSessionDecoderAndRenderProvider.hpp"
+#include "http.h"
 
 
 #ifdef _WIN32
@@ -37,7 +42,15 @@
 
 using namespace brls::literals; // for _i18n
 
+// Work that is not needed to draw the first frame
+static void startDeferredServices() {
+    StartupTrace::instance().deferred("box art manifest",
+                                      [] { BoxArtManager::instance(); });
+}
+
 int main(int argc, char* argv[]) {
+    StartupTrace::instance();
+
     // Enable recording for Twitter memes
 #ifdef __SWITCH__
     appletInitializeGamePlayRecording();
@@ -66,15 +79,22 @@ int main(int argc, char* argv[]) {
         brls::Logger::error("Unable to init Borealis application");
         return EXIT_FAILURE;
     }
+    StartupTrace::instance().mark("application init");
 
     MoonlightSession::set_provider(
             new SwitchMoonlightSessionDecoderAndRenderProvider());
 
     brls::Application::createWindow("title"_i18n);
+    StartupTrace::instance().mark("window");
 
     auto home = Application::getPlatform()->getHomeDirectory("Moonlight-Switch");
     Settings::instance().set_working_dir(home);
     brls::Logger::info("Working dir, {}", home);
+    StartupTrace::instance().mark("settings");
+
+    // Generates the client certificate in the background on first launch
+    ClientIdentity::instance().start();
+    StartupTrace::instance().mark("client identity");
 
     // Have the application register an action on every activity that will quit
     // when you press BUTTON_START
@@ -99,6 +119,7 @@ int main(int argc, char* argv[]) {
     brls::getStyle().addMetric("about/padding_top_bottom", 50);
     brls::getStyle().addMetric("about/padding_sides", 75);
     brls::getStyle().addMetric("about/description_margin", 50);
+    StartupTrace::instance().mark("views and theme");
 
     // Create and push the main activity to the stack if cannot run game from arguments
     if (!startFromArgs(argc, argv)) {
@@ -107,13 +128,23 @@ int main(int argc, char* argv[]) {
 
     brls::Application::enableDebuggingView(Settings::instance().write_log());
     brls::Application::setSwapInputKeys(Settings::instance().swap_ui_keys());
+    StartupTrace::instance().mark("main activity");
 
     // Run the app
-    while (brls::Application::mainLoop())
-        ;
+    while (brls::Application::mainLoop()) {
+        if (!StartupTrace::instance().has_first_frame()) {
+            StartupTrace::instance().first_frame();
+            startDeferredServices();
+        }
+
+        // Sleep until the stream has something new to show
+        AVFrameHolder::instance().waitForFrame();
+    }
 
     GameStreamClient::instance().stop();
     DiscoverManager::instance().pause();
+    Settings::instance().flush();
+    http_cleanup();
 
     // Exit
 #ifdef __SWITCH__
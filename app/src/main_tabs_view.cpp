@@ -13,9 +13,6 @@
 #include "settings_tab.hpp"
 
 MainTabs::MainTabs() {
-    favoriteTab = new FavoriteTab();
-    favoriteTab->ptrLock();
-
     MainTabs::instanse = this;
     refillTabs();
     lastHasAnyFavorites = Settings::instance().has_any_favorite();
@@ -24,7 +21,17 @@ MainTabs::MainTabs() {
 void MainTabs::willAppear(bool resetState) {
     Box::willAppear(resetState);
     updateFavoritesIfNeeded();
-    favoriteTab->refreshIfNeeded();
+    if (favoriteTab)
+        favoriteTab->refreshIfNeeded();
+}
+
+FavoriteTab* MainTabs::getFavoriteTab() {
+    // Inflated on first use, it is not needed when another tab is shown
+    if (!favoriteTab) {
+        favoriteTab = new FavoriteTab();
+        favoriteTab->ptrLock();
+    }
+    return favoriteTab;
 }
 
 void MainTabs::updateFavoritesIfNeeded() {
@@ -48,7 +55,7 @@ void MainTabs::refillTabs(bool keepFocus) {
 
     bool hasAnyFavorite = Settings::instance().has_any_favorite();
     if (hasAnyFavorite) {
-        addTab("tabs/favorites"_i18n, [this] { return this->favoriteTab; });
+        addTab("tabs/favorites"_i18n, [this] { return getFavoriteTab(); });
         addSeparator();
     }
     lastHasAnyFavorites = hasAnyFavorite;
@@ -12,6 +12,7 @@
 #include "settings_tab.hpp"
 #include "Settings.hpp"
 #include "helper.hpp"
+#include "BoxArtManager.hpp"
 #include "button_selecting_dialog.hpp"
 #include "mapping_layout_editor.hpp"
 #include <iomanip>
@@ -550,6 +551,31 @@ SettingsTab::SettingsTab() {
                        Settings::instance().set_write_log(value);
                        brls::Application::enableDebuggingView(value);
                    });
+
+    std::vector<std::string> boxartBudgets = {"settings/boxart_memory_default"_i18n,
+                                              "64 MB", "128 MB", "256 MB", "512 MB"};
+    boxartMemory->setText("settings/boxart_memory"_i18n);
+    boxartMemory->setData(boxartBudgets);
+    switch (Settings::instance().boxart_texture_budget()) {
+        GET_SETTINGS(boxartMemory, 0, 0);
+        GET_SETTINGS(boxartMemory, 64, 1);
+        GET_SETTINGS(boxartMemory, 128, 2);
+        GET_SETTINGS(boxartMemory, 256, 3);
+        GET_SETTINGS(boxartMemory, 512, 4);
+        DEFAULT;
+    }
+    boxartMemory->getEvent()->subscribe([](int selected) {
+        switch (selected) {
+            SET_SETTING(0, set_boxart_texture_budget(0));
+            SET_SETTING(1, set_boxart_texture_budget(64));
+            SET_SETTING(2, set_boxart_texture_budget(128));
+            SET_SETTING(3, set_boxart_texture_budget(256));
+            SET_SETTING(4, set_boxart_texture_budget(512));
+            DEFAULT;
+        }
+        BoxArtManager::instance().set_texture_budget(
+            (size_t)Settings::instance().boxart_texture_budget() * 1024 * 1024);
+    });
 }
 
 void SettingsTab::updateDeadZoneItems() {
@@ -7,6 +7,10 @@
 
 #include "AVFrameHolder.hpp"
 
+// Upper bound on an idle UI loop iteration, keeps touch and overlay combos
+// responsive when the host sends few frames
+static const std::chrono::milliseconds max_idle_wait(16);
+
 AVFrameQueue::AVFrameQueue() {}
 
 AVFrameQueue::~AVFrameQueue() {
@@ -31,9 +35,10 @@ void AVFrameQueue::push(AVFrame* item) {
     }
 }
 
-AVFrame* AVFrameQueue::pop() {
+AVFrame* AVFrameQueue::pop(bool* fresh) {
     std::lock_guard<std::mutex> lock(m_mutex);
 
+    *fresh = !queue.empty();
     if (!queue.empty()) {
         AVFrame* item = queue.front();
         queue.pop();
@@ -63,4 +68,21 @@ void AVFrameQueue::cleanup() {
     framesDroppedStat = 0;
     bufferFrame = nullptr;
     queue = {};
-}
\ No newline at end of file
+}
+
+void AVFrameHolder::waitForFrame() {
+    if (!m_paced)
+        return;
+
+    std::unique_lock<std::mutex> lock(m_present_mutex);
+    m_present.wait_for(lock, max_idle_wait, [this] { return m_pending; });
+    m_pending = false;
+}
+
+void AVFrameHolder::wake() {
+    {
+        std::lock_guard<std::mutex> lock(m_present_mutex);
+        m_pending = true;
+    }
+    m_present.notify_one();
+}
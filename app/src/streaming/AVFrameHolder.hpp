@@ -1,6 +1,9 @@
 #pragma once
 
 #include "Singleton.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <mutex>
 #include <functional>
 #include <queue>
@@ -16,7 +19,9 @@ public:
     ~AVFrameQueue();
 
     void push(AVFrame* item);
-    AVFrame* pop();
+    // Falls back to the last frame when nothing new was queued, fresh tells
+    // the two apart
+    AVFrame* pop(bool* fresh);
 
     [[nodiscard]] size_t size() const;
     [[nodiscard]] size_t getFakeFrameUsage() const;
@@ -40,19 +45,27 @@ class AVFrameHolder : public Singleton<AVFrameHolder> {
     void push(AVFrame* frame) {
         m_frame_queue.push(frame);
         stat ++;
+        wake();
     }
 
-    void get(const std::function<void(AVFrame*)>& fn) {
-        auto frame = m_frame_queue.pop();
+    void get(const std::function<void(AVFrame*, bool)>& fn) {
+        bool fresh;
+        auto frame = m_frame_queue.pop(&fresh);
 
         if (frame) {
-            fn(frame);
+            fn(frame, fresh);
             stat --;
         }
     }
 
+    // While paced the UI loop only runs when the decoder presents a frame,
+    // something calls wake() or max_idle_wait passes
+    void setPaced(bool paced) { m_paced = paced; }
+    void waitForFrame();
+    void wake();
+
     void prepare() {
-        m_frame_queue.limit = Settings::instance().frames_queue_size();
+        m_frame_queue.limit = Settings::instance().snapshot()->frames_queue_size;
     }
 
     void cleanup() {
@@ -68,4 +81,9 @@ class AVFrameHolder : public Singleton<AVFrameHolder> {
   private:
     AVFrameQueue m_frame_queue;
     int stat = 0;
+
+    std::atomic<bool> m_paced = false;
+    std::mutex m_present_mutex;
+    std::condition_variable m_present;
+    bool m_pending = false;
 };
@@ -7,17 +7,146 @@
 
 #include "DiscoverManager.hpp"
 #include "GameStreamClient.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <functional>
+
+#if defined(_WIN32)
+#include <winsock2.h>
+#include <ws2tcpip.h>
+
+typedef SOCKET probe_socket_t;
+#define PROBE_INVALID_SOCKET INVALID_SOCKET
+#define probe_close closesocket
+#define probe_poll WSAPoll
+#else
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+typedef int probe_socket_t;
+#define PROBE_INVALID_SOCKET -1
+#define probe_close close
+#define probe_poll poll
+#endif
 
 using namespace brls::literals;
 
-DiscoverManager::DiscoverManager() {
-    reset();
-    start();
+static const unsigned short probe_port = 47989;
+static const std::chrono::milliseconds probe_timeout(400);
+#ifdef __SWITCH__
+// The console only has a small pool of BSD sockets to share with curl
+static const size_t probe_max_in_flight = 24;
+#else
+static const size_t probe_max_in_flight = 64;
+#endif
+
+struct Probe {
+    probe_socket_t socket;
+    size_t index;
+    std::chrono::steady_clock::time_point started;
+};
+
+static probe_socket_t open_probe(const std::string& address) {
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(probe_port);
+    if (inet_pton(AF_INET, address.c_str(), &addr.sin_addr) != 1)
+        return PROBE_INVALID_SOCKET;
+
+    probe_socket_t sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (sock == PROBE_INVALID_SOCKET)
+        return PROBE_INVALID_SOCKET;
+
+#if defined(_WIN32)
+    u_long nonblocking = 1;
+    ioctlsocket(sock, FIONBIO, &nonblocking);
+#else
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+#endif
+
+    if (connect(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+#if defined(_WIN32)
+        bool pending = WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+        bool pending = errno == EINPROGRESS;
+#endif
+        if (!pending) {
+            probe_close(sock);
+            return PROBE_INVALID_SOCKET;
+        }
+    }
+    return sock;
 }
 
+static bool probe_succeeded(probe_socket_t sock) {
+    int error = 0;
+    socklen_t length = sizeof(error);
+    if (getsockopt(sock, SOL_SOCKET, SO_ERROR, (char*)&error, &length) != 0)
+        return false;
+    return error == 0;
+}
+
+// Connects to the GameStream port of addresses[*next...] with at most
+// probe_max_in_flight connections pending and reports every address that
+// accepts. On cancellation *next is rewound to the oldest unfinished probe.
+static void probe_addresses(const std::vector<std::string>& addresses,
+                            size_t* next,
+                            const std::function<bool()>& cancelled,
+                            const std::function<void(size_t)>& on_open) {
+    std::vector<Probe> probes;
+    std::vector<struct pollfd> fds;
+
+    while (*next < addresses.size() || !probes.empty()) {
+        if (cancelled()) {
+            for (const Probe& probe : probes) {
+                *next = std::min(*next, probe.index);
+                probe_close(probe.socket);
+            }
+            return;
+        }
+
+        while (*next < addresses.size() &&
+               probes.size() < probe_max_in_flight) {
+            size_t index = (*next)++;
+            probe_socket_t sock = open_probe(addresses[index]);
+            if (sock != PROBE_INVALID_SOCKET)
+                probes.push_back(
+                    {sock, index, std::chrono::steady_clock::now()});
+        }
+
+        fds.clear();
+        for (const Probe& probe : probes)
+            fds.push_back({probe.socket, POLLOUT, 0});
+
+        if (!fds.empty())
+            probe_poll(fds.data(), (unsigned long)fds.size(), 50);
+
+        auto now = std::chrono::steady_clock::now();
+        for (size_t i = probes.size(); i-- > 0;) {
+            bool done = fds[i].revents & (POLLOUT | POLLERR | POLLHUP);
+            if (done && probe_succeeded(probes[i].socket))
+                on_open(probes[i].index);
+
+            if (done || now - probes[i].started >= probe_timeout) {
+                probe_close(probes[i].socket);
+                probes.erase(probes.begin() + i);
+            }
+        }
+    }
+}
+
+// Scanning starts once the add host tab asks for it, not at launch
+DiscoverManager::DiscoverManager() { reset(); }
+
 void DiscoverManager::reset() {
     pause();
+    generation++;
     counter = 0;
+    pendingServerInfo = 0;
     addresses.clear();
     _hosts.clear();
     hosts = hosts.success(std::vector<Host>());
@@ -37,39 +166,103 @@ void DiscoverManager::start() {
 
     if (paused) {
         paused = false;
-        brls::async([] { DiscoverManager::instance().loop(); });
+        spawn();
     }
     brls::sync([this] { getHostsUpdateEvent()->fire(hosts); });
 }
 
 void DiscoverManager::pause() { paused = true; }
 
-void DiscoverManager::loop() {
-    brls::async([this] {
-        while (counter < addresses.size() && !paused) {
-            SERVER_DATA server_data;
+void DiscoverManager::spawn() {
+    if (running.exchange(true))
+        return;
+
+    sweepStart = std::chrono::steady_clock::now();
+
+    // The sweep works on its own copy so reset() can run meanwhile
+    int generation = this->generation;
+    std::vector<std::string> addresses = this->addresses;
+    size_t next = counter;
+
+    brls::async([this, generation, addresses, next]() mutable {
+        probe_addresses(
+            addresses, &next,
+            [this, generation] {
+                return paused || generation != this->generation;
+            },
+            [this, generation, &addresses](size_t index) {
+                std::string address = addresses[index];
+                brls::sync([this, generation, address] {
+                    probed(generation, address);
+                });
+            });
+
+        brls::sync([this, generation, next] {
+            running = false;
+
+            if (generation == this->generation)
+                counter = next;
+
+            // Resumed or reset while this sweep was winding down
+            if (!paused && counter < this->addresses.size()) {
+                spawn();
+                return;
+            }
+            finishIfDone();
+        });
+    });
+}
+
+void DiscoverManager::probed(int generation, const std::string& address) {
+    if (generation != this->generation)
+        return;
+
+    pendingServerInfo++;
+    brls::async([this, generation, address] {
+        SERVER_DATA server_data;
+        int status = gs_init(&server_data, address);
 
-            int status = gs_init(&server_data, addresses[counter]);
-            if (status == GS_OK) {
+        brls::sync([this, generation, address, status, server_data] {
+            if (generation != this->generation)
+                return;
+
+            pendingServerInfo--;
+
+            bool known = std::any_of(
+                _hosts.begin(), _hosts.end(),
+                [address](const Host& host) { return host.address == address; });
+
+            if (status == GS_OK && !known) {
                 Host host;
-                host.address = addresses[counter];
+                host.address = address;
                 host.hostname = server_data.hostname;
                 host.mac = server_data.mac;
+                host.uniqueid = server_data.uniqueid;
                 _hosts.push_back(host);
                 hosts = hosts.success(_hosts);
-                brls::sync([this] { getHostsUpdateEvent()->fire(hosts); });
+                getHostsUpdateEvent()->fire(hosts);
             }
 
-            counter++;
-        }
+            finishIfDone();
+        });
+    });
+}
 
-        if (counter == addresses.size() && _hosts.empty()) {
-            hosts = hosts.failure("discovery_manager/no_host"_i18n);
-            brls::sync([this] { getHostsUpdateEvent()->fire(hosts); });
-        }
+void DiscoverManager::finishIfDone() {
+    if (running || pendingServerInfo > 0 || counter < addresses.size())
+        return;
 
-        paused = true;
-    });
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - sweepStart);
+    brls::Logger::info("DiscoverManager: Swept {} addresses in {} ms, found {}",
+                       addresses.size(), elapsed.count(), _hosts.size());
+
+    if (_hosts.empty()) {
+        hosts = hosts.failure("discovery_manager/no_host"_i18n);
+        getHostsUpdateEvent()->fire(hosts);
+    }
+
+    paused = true;
 }
 
 DiscoverManager::~DiscoverManager() { paused = true; }
@@ -10,7 +10,9 @@
 #include "GameStreamClient.hpp"
 #include "Settings.hpp"
 #include "Singleton.hpp"
+#include <atomic>
 #include <borealis.hpp>
+#include <chrono>
 #include <pthread.h>
 #include <stdio.h>
 
@@ -32,11 +34,19 @@ class DiscoverManager : public Singleton<DiscoverManager> {
     void pause();
 
   private:
-    void loop();
+    void spawn();
+    void probed(int generation, const std::string& address);
+    void finishIfDone();
+
     std::vector<std::string> addresses;
     GSResult<std::vector<Host>> hosts;
     std::vector<Host> _hosts;
     brls::Event<GSResult<std::vector<Host>>> hostsUpdateEvent;
-    int counter = 0;
-    bool paused = true;
+    size_t counter = 0;
+    std::atomic<bool> paused = true;
+    std::atomic<bool> running = false;
+    // Bumped by reset() so results of a cancelled sweep are dropped
+    std::atomic<int> generation = 0;
+    int pendingServerInfo = 0;
+    std::chrono::steady_clock::time_point sweepStart;
 };
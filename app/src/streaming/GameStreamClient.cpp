@@ -1,13 +1,14 @@
 #include "GameStreamClient.hpp"
 #include "Settings.hpp"
 #include "WakeOnLanManager.hpp"
+#include <algorithm>
 #include <borealis.hpp>
+#include <set>
 #include <thread>
 #include <unistd.h>
 #include <vector>
 
 #include <curl/curl.h>
-#include <libretro-common/retro_timers.h>
 #include <cstring>
 
 #include <arpa/inet.h>
@@ -20,169 +21,191 @@
 #include <sys/ioctl.h>
 #endif
 
-#if defined(__SWITCH__)
-#include <switch.h>
-
-// TODO: Remove when presented in LibNX
-struct ipv6_mreq {
-	struct in6_addr ipv6mr_multiaddr;
-	unsigned int    ipv6mr_interface;
-};
+#if !defined(PLATFORM_PSV) && !defined(__SWITCH__) && !defined(_WIN32)
+#include <ifaddrs.h>
 #endif
 
-#ifndef MULTICAST_DISABLED
-extern "C" {
-#include <mdns.h>
-}
+#if defined(__SWITCH__)
+#include <switch.h>
+#elif defined(__PSV__)
+#include <psp2/net/netctl.h>
 #endif
 
 using namespace brls;
+using namespace brls::literals;
+
+// How long cached serverinfo is served without asking the host again
+static const std::chrono::seconds server_data_ttl(30);
+
+// A woken host is polled with growing pauses until it answers serverinfo.
+// Magic packets are repeated meanwhile in case the first burst went out
+// before the NIC was listening.
+static const std::chrono::seconds wake_up_timeout(90);
+static const std::chrono::seconds wake_up_resend_interval(10);
+static const std::chrono::milliseconds wake_up_min_backoff(250);
+static const std::chrono::milliseconds wake_up_max_backoff(2000);
+
+// serverInfo points into the strings of the struct it was filled for, so
+// every copy has to be pointed at its own strings again
+static void bind_server_info(SERVER_DATA& data) {
+    data.serverInfo.address = data.address.c_str();
+    data.serverInfo.serverInfoAppVersion = data.serverInfoAppVersion.c_str();
+    data.serverInfo.serverInfoGfeVersion = data.serverInfoGfeVersion.c_str();
+}
 
 GameStreamClient::GameStreamClient() { start(); }
 
+SERVER_DATA GameStreamClient::server_data(const std::string& address) {
+    SERVER_DATA data = m_server_data[address];
+    bind_server_info(data);
+    return data;
+}
+
 void GameStreamClient::start() {}
 
 void GameStreamClient::stop() {}
 
-static uint32_t get_my_ip_address() {
-    uint32_t address = 0;
-#if defined(__linux) || defined(__APPLE__)
-    struct ifreq ifr;
-    ifr.ifr_addr.sa_family = AF_INET;
-    strncpy(ifr.ifr_name, "en0", IFNAMSIZ - 1);
+// Bigger subnets are only swept around our own address
+static const uint32_t max_scan_prefix_mask = 0xFFFFFC00; // /22
 
-    int fd = socket(AF_INET, SOCK_DGRAM, 0);
-    ioctl(fd, SIOCGIFADDR, &ifr);
-    close(fd);
+struct LocalNetwork {
+    // Host byte order
+    uint32_t address;
+    uint32_t netmask;
+};
 
-    address = ((struct sockaddr_in*)&ifr.ifr_addr)->sin_addr.s_addr;
-#elif defined(__SWITCH__)
-    nifmGetCurrentIpAddress(&address);
+static std::vector<LocalNetwork> get_local_networks() {
+    std::vector<LocalNetwork> networks;
+#if defined(__SWITCH__)
+    u32 address = 0, netmask = 0, gateway = 0, dns1 = 0, dns2 = 0;
+    if (R_SUCCEEDED(nifmGetCurrentIpConfigInfo(&address, &netmask, &gateway,
+                                                &dns1, &dns2)) &&
+        address != 0) {
+        networks.push_back({ntohl(address), ntohl(netmask)});
+    }
+#elif defined(__PSV__)
+    // The Vita has a single interface and no getifaddrs
+    SceNetCtlInfo address, netmask;
+    struct in_addr ip, mask;
+    if (sceNetCtlInetGetInfo(SCE_NETCTL_INFO_GET_IP_ADDRESS, &address) >= 0 &&
+        sceNetCtlInetGetInfo(SCE_NETCTL_INFO_GET_NETMASK, &netmask) >= 0 &&
+        inet_pton(AF_INET, address.ip_address, &ip) == 1 &&
+        inet_pton(AF_INET, netmask.netmask, &mask) == 1 && ip.s_addr != 0) {
+        networks.push_back({ntohl(ip.s_addr), ntohl(mask.s_addr)});
+    }
+#elif !defined(PLATFORM_PSV) && !defined(_WIN32)
+    struct ifaddrs* interfaces = nullptr;
+    if (getifaddrs(&interfaces) != 0)
+        return networks;
+
+    for (struct ifaddrs* ifa = interfaces; ifa; ifa = ifa->ifa_next) {
+        if (!ifa->ifa_addr || !ifa->ifa_netmask ||
+            ifa->ifa_addr->sa_family != AF_INET)
+            continue;
+
+        if (!(ifa->ifa_flags & IFF_UP) || (ifa->ifa_flags & IFF_LOOPBACK))
+            continue;
+
+        LocalNetwork network;
+        network.address =
+            ntohl(((struct sockaddr_in*)ifa->ifa_addr)->sin_addr.s_addr);
+        network.netmask =
+            ntohl(((struct sockaddr_in*)ifa->ifa_netmask)->sin_addr.s_addr);
+
+        // Point-to-point links and /31+ have nobody else to find
+        if (network.address != 0 && (~network.netmask) > 1)
+            networks.push_back(network);
+    }
+    freeifaddrs(interfaces);
 #endif
-    return address;
+    return networks;
 }
 
-std::vector<std::string> GameStreamClient::host_addresses_for_find() {
-    std::vector<std::string> addresses;
-
-    uint32_t address = get_my_ip_address();
-    bool isSucceed = address != 0;
-
-    if (isSucceed) {
-        uint32_t a = address & 0xFF;
-        uint32_t b = (address >> 8) & 0xFF;
-        uint32_t c = (address >> 16) & 0xFF;
-        uint32_t d = (address >> 24) & 0xFF;
-
-        for (int i = 0; i < 256; i++) {
-            if (i == d) {
+// Neighbors the kernel already resolved are the likeliest hosts
+static std::vector<uint32_t> get_neighbor_addresses() {
+    std::vector<uint32_t> neighbors;
+#if defined(__linux) && !defined(__SWITCH__)
+    FILE* f = fopen("/proc/net/arp", "r");
+    if (!f)
+        return neighbors;
+
+    char line[256];
+    // Skip the header
+    if (fgets(line, sizeof(line), f)) {
+        while (fgets(line, sizeof(line), f)) {
+            char ip[64];
+            unsigned int type, flags;
+            if (sscanf(line, "%63s 0x%x 0x%x", ip, &type, &flags) != 3)
                 continue;
-            }
-            addresses.push_back(std::to_string(a) + "." + std::to_string(b) +
-                                "." + std::to_string(c) + "." +
-                                std::to_string(i));
-        }
-    }
-    return addresses;
-}
-
-bool GameStreamClient::can_find_host() { return get_my_ip_address() != 0; }
-
-#ifndef MULTICAST_DISABLED
- static std::vector<Host> foundHosts;
- static std::string foundHost;
 
-std::string get_ip_str(const struct sockaddr *addr)
-{
-    char addrStr[INET6_ADDRSTRLEN];
-    if (addr->sa_family == AF_INET) {
-        inet_ntop(addr->sa_family, &((struct sockaddr_in*)addr)->sin_addr, addrStr, sizeof(addrStr));
-        unsigned short port = htons(((struct sockaddr_in*)addr)->sin_port);
-        return fmt::format("{}", addrStr);
-    }
-    else {
-        struct sockaddr_in6* sin6 = (struct sockaddr_in6*)addr;
-        inet_ntop(addr->sa_family, &sin6->sin6_addr, addrStr, sizeof(addrStr));
-        unsigned short port = ntohs(((struct sockaddr_in6*)addr)->sin6_port);
-        if (sin6->sin6_scope_id != 0) {
-            // Link-local addresses with scope IDs are special
-            return fmt::format("{}{}", addrStr, sin6->sin6_scope_id);
-        }
-        else {
-            return fmt::format("{}", addrStr);
+            // ATF_COM: the entry has a resolved hardware address
+            struct in_addr addr;
+            if ((flags & 0x2) && inet_pton(AF_INET, ip, &addr) == 1)
+                neighbors.push_back(ntohl(addr.s_addr));
         }
     }
+    fclose(f);
+#endif
+    return neighbors;
 }
 
-static int mdns_discovery_callback(int sock, const struct sockaddr* from, size_t addrlen,
-                                   mdns_entry_type_t entry, uint16_t query_id, uint16_t type,
-                                   uint16_t rclass, uint32_t ttl, const void* data, size_t size,
-                                   size_t offset, size_t length, size_t record_offset,
-                                   size_t record_length, void* user_data)
-{
-    if (type == MDNS_RECORDTYPE_A) {
-        foundHost = get_ip_str(from);
-    }
-    return 0;
+static std::string ip_to_string(uint32_t address) {
+    return std::to_string((address >> 24) & 0xFF) + "." +
+           std::to_string((address >> 16) & 0xFF) + "." +
+           std::to_string((address >> 8) & 0xFF) + "." +
+           std::to_string(address & 0xFF);
 }
 
-void GameStreamClient::find_hosts(ServerCallback<std::vector<Host>>& callback) {
-    brls::async([callback] {
-        foundHosts.clear();
-
-        size_t capacity = 2048;
-        void* buffer = malloc(capacity);
-        size_t records;
+std::vector<std::string> GameStreamClient::host_addresses_for_find() {
+    std::vector<LocalNetwork> networks = get_local_networks();
+
+    std::vector<uint32_t> own;
+    std::vector<uint32_t> targets;
+    for (LocalNetwork network : networks) {
+        own.push_back(network.address);
+
+        uint32_t netmask = network.netmask | max_scan_prefix_mask;
+        uint32_t first = (network.address & netmask) + 1;
+        uint32_t last = (network.address | ~netmask) - 1;
+        for (uint32_t address = first; address <= last; address++)
+            targets.push_back(address);
+    }
 
+    std::set<uint32_t> scan(targets.begin(), targets.end());
+    auto in_scan = [&](uint32_t address) { return scan.count(address) > 0; };
+
+    // Saved hosts first, then known neighbors, then everything else
+    std::vector<uint32_t> ordered;
+    for (const Host& host : Settings::instance().hosts()) {
+        struct in_addr addr;
+        std::string ip = host.address.substr(0, host.address.find(':'));
+        if (inet_pton(AF_INET, ip.c_str(), &addr) == 1 &&
+            in_scan(ntohl(addr.s_addr)))
+            ordered.push_back(ntohl(addr.s_addr));
+    }
 
-        int sock = mdns_socket_open_ipv4(nullptr);
-        if (sock < 0) {
-            return;
-        }
+    for (uint32_t address : get_neighbor_addresses()) {
+        if (in_scan(address))
+            ordered.push_back(address);
+    }
 
-        if (mdns_query_send(sock, MDNS_RECORDTYPE_PTR,
-                        MDNS_STRING_CONST("_nvstream._tcp.local"),
-                        buffer, capacity, 0)) {
-            brls::sync([callback] {
-                callback(GSResult<std::vector<Host>>::failure(
-                        "error/unknown_error"_i18n));
-            });
-            return;
-        }
+    size_t prioritized = ordered.size();
+    ordered.insert(ordered.end(), targets.begin(), targets.end());
 
-        int empty_cnt = 0;
-        while (true) {
-            records = mdns_query_recv(sock, buffer, capacity, mdns_discovery_callback, (void*)(&callback), 0);
-            if (records == 0) {
-                empty_cnt++;
-            } else {
-                empty_cnt = 0;
-
-                SERVER_DATA server_data;
-
-                int status = gs_init(&server_data, foundHost);
-                if (status == GS_OK) {
-                    Host host;
-                    host.address = foundHost;
-                    host.hostname = server_data.hostname;
-                    host.mac = server_data.mac;
-                    foundHosts.push_back(host);
-
-                    brls::sync([callback] {
-                        callback(GSResult<std::vector<Host>>::success(foundHosts));
-                    });
-                }
-            }
-            // wait 30sec after last receive
-            if (empty_cnt >= 10) {
-                break;
-            }
+    std::vector<std::string> addresses;
+    std::set<uint32_t> seen(own.begin(), own.end());
+    for (uint32_t address : ordered) {
+        if (seen.insert(address).second)
+            addresses.push_back(ip_to_string(address));
+    }
 
-            retro_sleep(500);
-        }
-    });
+    brls::Logger::info(
+        "GameStreamClient: {} scan targets on {} interfaces, {} prioritized",
+        addresses.size(), networks.size(), prioritized);
+    return addresses;
 }
-#endif
+
+bool GameStreamClient::can_find_host() { return !get_local_networks().empty(); }
 
 bool GameStreamClient::can_wake_up_host(const Host& host) {
     return WakeOnLanManager::can_wake_up_host(host);
@@ -191,31 +214,128 @@ bool GameStreamClient::can_wake_up_host(const Host& host) {
 void GameStreamClient::wake_up_host(const Host& host,
                                     ServerCallback<bool>& callback) {
     brls::async([host, callback] {
+        auto start = std::chrono::steady_clock::now();
         auto result = WakeOnLanManager::wake_up_host(host);
 
-        if (result.isSuccess()) {
-            usleep(5'000'000);
-            brls::sync([callback, result] { callback(result); });
-        } else {
+        if (!result.isSuccess()) {
             brls::sync([callback, result] { callback(result); });
+            return;
+        }
+
+        auto lastSent = start;
+        auto backoff = wake_up_min_backoff;
+
+        while (std::chrono::steady_clock::now() - start < wake_up_timeout) {
+            SERVER_DATA server_data;
+            if (WakeOnLanManager::is_host_listening(host, 500) &&
+                gs_init(&server_data, host.address) == GS_OK) {
+                auto elapsed =
+                    std::chrono::duration_cast<std::chrono::milliseconds>(
+                        std::chrono::steady_clock::now() - start);
+                brls::Logger::info(
+                    "GameStreamClient: {} ready {} ms after wake up",
+                    host.hostname, elapsed.count());
+
+                brls::sync([host, callback, server_data] {
+                    auto& client = GameStreamClient::instance();
+                    client.store_server_data(host.address, server_data);
+                    callback(GSResult<bool>::success(true));
+                });
+                return;
+            }
+
+            std::this_thread::sleep_for(backoff);
+            backoff = std::min(backoff * 2, wake_up_max_backoff);
+
+            auto now = std::chrono::steady_clock::now();
+            if (now - lastSent >= wake_up_resend_interval) {
+                WakeOnLanManager::wake_up_host(host);
+                lastSent = now;
+            }
         }
+
+        brls::Logger::error("GameStreamClient: {} did not wake up in {} s",
+                            host.hostname, wake_up_timeout.count());
+        brls::sync([callback] {
+            callback(GSResult<bool>::failure("host/wake_up_error"_i18n));
+        });
     });
 }
 
 void GameStreamClient::connect(const std::string& address,
-                               ServerCallback<SERVER_DATA>& callback) {
-    m_server_data[address] = SERVER_DATA();
+                               ServerCallback<SERVER_DATA>& callback,
+                               bool allowCached) {
+    if (allowCached && m_server_data_time.count(address)) {
+        m_cache_hits++;
+        brls::Logger::debug(
+            "GameStreamClient: serverinfo cache hit for {} ({} hits, {} misses)",
+            address, m_cache_hits, m_cache_misses);
+
+        auto age = std::chrono::steady_clock::now() - m_server_data_time[address];
+        if (age >= server_data_ttl)
+            revalidate(address);
+
+        brls::sync([this, address, callback] {
+            callback(GSResult<SERVER_DATA>::success(server_data(address)));
+        });
+        return;
+    }
+
+    m_cache_misses++;
+    brls::Logger::debug(
+        "GameStreamClient: serverinfo cache miss for {} ({} hits, {} misses)",
+        address, m_cache_hits, m_cache_misses);
 
     brls::async([this, address, callback] {
-        int status = gs_init(&m_server_data[address], address);
+        SERVER_DATA server_data;
+        int status = gs_init(&server_data, address);
+        std::string error = status == GS_OK ? "" : gs_error();
 
-        brls::sync([this, address, callback, status] {
+        brls::sync([this, address, callback, status, error, server_data] {
             if (status == GS_OK) {
-                callback(
-                    GSResult<SERVER_DATA>::success(m_server_data[address]));
+                store_server_data(address, server_data);
+                callback(GSResult<SERVER_DATA>::success(
+                    this->server_data(address)));
             } else {
-                m_server_data.erase(address);
-                callback(GSResult<SERVER_DATA>::failure(gs_error()));
+                invalidate(address);
+                callback(GSResult<SERVER_DATA>::failure(error));
+            }
+        });
+    });
+}
+
+void GameStreamClient::invalidate(const std::string& address) {
+    m_server_data_time.erase(address);
+}
+
+void GameStreamClient::store_server_data(const std::string& address,
+                                         const SERVER_DATA& data) {
+    SERVER_DATA& stored = m_server_data[address];
+    stored = data;
+    bind_server_info(stored);
+
+    m_server_data_time[address] = std::chrono::steady_clock::now();
+}
+
+void GameStreamClient::revalidate(const std::string& address) {
+    if (m_revalidating.count(address))
+        return;
+
+    m_revalidating.insert(address);
+
+    brls::async([this, address] {
+        SERVER_DATA server_data;
+        int status = gs_init(&server_data, address);
+
+        brls::sync([this, address, status, server_data] {
+            m_revalidating.erase(address);
+
+            if (status == GS_OK) {
+                store_server_data(address, server_data);
+            } else {
+                brls::Logger::info(
+                    "GameStreamClient: {} did not answer revalidation", address);
+                invalidate(address);
             }
         });
     });
@@ -228,14 +348,25 @@ void GameStreamClient::pair(const std::string& address, const std::string& pin,
         return;
     }
 
-    brls::async([this, address, pin, callback] {
-        int status = gs_pair(&m_server_data[address], (char*)pin.c_str());
+    // Workers get their own copy, the cached one may be replaced by a
+    // revalidation while they run
+    SERVER_DATA server_data = this->server_data(address);
+
+    brls::async([this, address, pin, callback, server_data]() mutable {
+        bind_server_info(server_data);
+        int status = gs_pair(&server_data, (char*)pin.c_str());
+        std::string error = status == GS_OK ? "" : gs_error();
+
+        brls::sync([this, address, callback, status, error, server_data] {
+            // Keep the pairing state without marking it fresh
+            m_server_data[address] = server_data;
+            bind_server_info(m_server_data[address]);
+            invalidate(address);
 
-        brls::sync([callback, status] {
             if (status == GS_OK) {
                 callback(GSResult<bool>::success(true));
             } else {
-                callback(GSResult<bool>::failure(gs_error()));
+                callback(GSResult<bool>::failure(error));
             }
         });
     });
@@ -249,12 +380,18 @@ void GameStreamClient::applist(const std::string& address,
         return;
     }
 
-    brls::async([this, address, callback] {
+    SERVER_DATA server_data = this->server_data(address);
+
+    brls::async([address, callback, server_data]() mutable {
+        bind_server_info(server_data);
         PAPP_LIST list;
 
-        int status = gs_applist(&m_server_data[address], &list);
+        int status = gs_applist(&server_data, &list);
         if (status != CURLE_OK) {
-            callback(GSResult<AppInfoList>::failure(gs_error()));
+            std::string error = gs_error();
+            brls::sync([callback, error] {
+                callback(GSResult<AppInfoList>::failure(error));
+            });
             return;
         }
 
@@ -274,12 +411,8 @@ void GameStreamClient::applist(const std::string& address,
         std::sort(app_list.begin(), app_list.end(),
                   [](const AppInfo& a, const AppInfo& b) { return a.name < b.name; });
 
-        brls::sync([app_list, callback, status] {
-            if (status == GS_OK) {
-                callback(GSResult<AppInfoList>::success(app_list));
-            } else {
-                callback(GSResult<AppInfoList>::failure(gs_error()));
-            }
+        brls::sync([app_list, callback] {
+            callback(GSResult<AppInfoList>::success(app_list));
         });
     });
 }
@@ -291,15 +424,19 @@ void GameStreamClient::app_boxart(const std::string& address, int app_id,
         return;
     }
 
-    brls::async([this, address, app_id, callback] {
+    SERVER_DATA server_data = this->server_data(address);
+
+    brls::async([app_id, callback, server_data]() mutable {
+        bind_server_info(server_data);
         Data data;
-        int status = gs_app_boxart(&m_server_data[address], app_id, &data);
+        int status = gs_app_boxart(&server_data, app_id, &data);
+        std::string error = status == GS_OK ? "" : gs_error();
 
-        brls::sync([callback, data, status] {
+        brls::sync([callback, data = std::move(data), status, error] {
             if (status == GS_OK) {
                 callback(GSResult<Data>::success(data));
             } else {
-                callback(GSResult<Data>::failure(gs_error()));
+                callback(GSResult<Data>::failure(error));
             }
         });
     });
@@ -316,16 +453,24 @@ void GameStreamClient::start(const std::string& address,
 
     m_config = config;
 
-    brls::async([this, address, app_id, callback] {
-        int status = gs_start_app(&m_server_data[address], &m_config, app_id,
+    SERVER_DATA server_data = this->server_data(address);
+
+    brls::async([this, address, app_id, callback, server_data]() mutable {
+        bind_server_info(server_data);
+        int status = gs_start_app(&server_data, &m_config, app_id,
                                   Settings::instance().sops(),
                                   Settings::instance().play_audio(), 0x1);
+        std::string error = status == GS_OK ? "" : gs_error();
+
+        brls::sync([this, address, callback, status, error, server_data] {
+            m_server_data[address] = server_data;
+            bind_server_info(m_server_data[address]);
+            invalidate(address);
 
-        brls::sync([this, callback, status] {
             if (status == GS_OK) {
                 callback(GSResult<STREAM_CONFIGURATION>::success(m_config));
             } else {
-                callback(GSResult<STREAM_CONFIGURATION>::failure(gs_error()));
+                callback(GSResult<STREAM_CONFIGURATION>::failure(error));
             }
         });
     });
@@ -338,16 +483,20 @@ void GameStreamClient::quit(const std::string& address,
         return;
     }
 
-    auto server_data = m_server_data[address];
+    SERVER_DATA server_data = this->server_data(address);
+
+    brls::async([this, address, server_data, callback]() mutable {
+        bind_server_info(server_data);
+        int status = gs_quit_app(&server_data);
+        std::string error = status == GS_OK ? "" : gs_error();
 
-    brls::async([server_data, callback] {
-        int status = gs_quit_app((PSERVER_DATA)&server_data);
+        brls::sync([this, address, callback, status, error] {
+            invalidate(address);
 
-        brls::sync([callback, status] {
             if (status == GS_OK) {
                 callback(GSResult<bool>::success(true));
             } else {
-                callback(GSResult<bool>::failure(gs_error()));
+                callback(GSResult<bool>::failure(error));
             }
         });
     });
@@ -3,8 +3,10 @@
 #include "Settings.hpp"
 #include "client.h"
 #include "errors.h"
+#include <chrono>
 #include <functional>
 #include <map>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -52,9 +54,7 @@ using AppInfoList = std::vector<AppInfo>;
 
 class GameStreamClient : public Singleton<GameStreamClient> {
   public:
-    SERVER_DATA server_data(const std::string& address) {
-        return m_server_data[address];
-    }
+    SERVER_DATA server_data(const std::string& address);
 
     GameStreamClient();
 
@@ -64,13 +64,18 @@ class GameStreamClient : public Singleton<GameStreamClient> {
     static std::vector<std::string> host_addresses_for_find();
 
     static bool can_find_host();
-    static void find_hosts(ServerCallback<std::vector<Host>>& callback);
 
     static bool can_wake_up_host(const Host& host);
     static void wake_up_host(const Host& host, ServerCallback<bool>& callback);
 
+    // Returns the cached serverinfo right away when there is one (refreshing
+    // it in the background once it is older than the TTL). Pass
+    // allowCached = false when the caller needs the live host state.
     void connect(const std::string& address,
-                 ServerCallback<SERVER_DATA>& callback);
+                 ServerCallback<SERVER_DATA>& callback,
+                 bool allowCached = true);
+    // Forces the next connect() to this host to fetch serverinfo again
+    void invalidate(const std::string& address);
     void pair(const std::string& address, const std::string& pin,
               ServerCallback<bool>& callback);
     void applist(const std::string& address,
@@ -82,6 +87,13 @@ class GameStreamClient : public Singleton<GameStreamClient> {
     void quit(const std::string& address, ServerCallback<bool>& callback);
 
   private:
+    void store_server_data(const std::string& address, const SERVER_DATA& data);
+    void revalidate(const std::string& address);
+
     std::map<std::string, SERVER_DATA> m_server_data;
+    std::map<std::string, std::chrono::steady_clock::time_point> m_server_data_time;
+    std::set<std::string> m_revalidating;
+    size_t m_cache_hits = 0;
+    size_t m_cache_misses = 0;
     STREAM_CONFIGURATION m_config;
 };
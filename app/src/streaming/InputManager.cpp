@@ -7,11 +7,47 @@
 #include "Limelight.h"
 #include "Settings.hpp"
 #include <borealis.hpp>
-#include <streaming_view.hpp>
+#include <algorithm>
 #include <chrono>
+#include <cmath>
 
 using namespace brls;
 
+static const int min_input_poll_rate = 250;
+static const int max_input_poll_rate = 1000;
+
+// Motion is sent at most this often per controller and sensor
+static const std::chrono::milliseconds motion_send_interval(4);
+// Averaged samples closer than this to the last sent ones are dropped
+static const float accel_send_threshold = 0.05f; // m/s^2
+static const float gyro_send_threshold = 0.25f; // deg/s
+// Held touches that moved less than this (in content pixels) are not resent
+static const float touch_move_threshold = 1.0f;
+
+void LatencyHistogram::add(double us) {
+    int bucket = 0;
+    while (bucket < buckets - 1 && us >= (double)(1 << bucket))
+        bucket++;
+
+    counts[bucket]++;
+    total++;
+    max_us = std::max(max_us, us);
+}
+
+double LatencyHistogram::percentile(double p) const {
+    if (total == 0)
+        return 0;
+
+    uint64_t target = (uint64_t)std::ceil(total * p);
+    uint64_t seen = 0;
+    for (int i = 0; i < buckets; i++) {
+        seen += counts[i];
+        if (seen >= target)
+            return std::min((double)(1 << i), max_us);
+    }
+    return max_us;
+}
+
 float fsqrt_(float f) {
     int i = *(int *)&f;
     i = (i >> 1) + 0x1fbb67ae;
@@ -20,71 +56,104 @@ float fsqrt_(float f) {
 
 }
 
-MoonlightInputManager::MoonlightInputManager() {
-    auto inputManager = brls::Application::getPlatform()->getInputManager();
+MoonlightInputManager::MoonlightInputManager(
+    std::unique_ptr<InputSource> source)
+    : source(std::move(source)) {}
 
-    inputManager
-        ->getMouseCusorOffsetChanged()
-        ->subscribe([this](brls::Point offset) {
-            if (!inputEnabled) return;
+MoonlightInputManager::~MoonlightInputManager() { stopPolling(); }
 
-            if (offset.x != 0 || offset.y != 0) {
-                float multiplier =
-                        (float) Settings::instance().get_mouse_speed_multiplier() / 100.f *
-                        1.5f + 0.5f;
+void MoonlightInputManager::startPolling() {
+    stopPolling();
+    mainThread = std::this_thread::get_id();
 
-                if (!this->inputDropped) {
-                    LiSendMouseMoveEvent(short(offset.x * multiplier),
-                                         short(offset.y * multiplier));
-                }
-            }
-        });
+    int rate = Settings::instance().input_poll_rate();
+#ifdef INPUT_POLL_THREAD
+    if (rate > 0)
+        rate = std::clamp(rate, min_input_poll_rate, max_input_poll_rate);
+#else
+    rate = 0;
+#endif
 
-    inputManager
-        ->getMouseScrollOffsetChanged()
-        ->subscribe([this](brls::Point scroll) {
-            if (!inputEnabled) return;
+    {
+        std::lock_guard<std::mutex> lock(controllersMutex);
+        stats = InputPollStats();
+        stats.rate = rate;
+        totalLatencyUs = 0;
+        totalFrameUs = 0;
+        controllersDropped = true;
+    }
 
-            if (scroll.x != 0) {
-                brls::Logger::info("Mouse scroll X sended: {}", scroll.x);
-                LiSendHighResHScrollEvent( short(scroll.x));
-            }
-            if (scroll.y != 0) {
-                brls::Logger::info("Mouse scroll Y sended: {}", scroll.y);
-                LiSendHighResScrollEvent( short(scroll.y));
-            }
-        });
+    if (rate == 0)
+        return;
 
-    inputManager
-        ->getKeyboardKeyStateChanged()
-        ->subscribe([this](brls::KeyState state) {
-            if (!inputEnabled) return;
+    brls::Logger::info("InputManager: Polling controllers at {} Hz", rate);
+    polling = true;
+    pollThread = std::thread([this, rate] { pollLoop(rate); });
+}
 
-            int vkKey = MoonlightInputManager::glfwKeyToVKKey(state.key);
-            char modifiers = state.mods;
-            LiSendKeyboardEvent(vkKey,
-                                state.pressed ? KEY_ACTION_DOWN : KEY_ACTION_UP,
-                                modifiers);
-        });
+void MoonlightInputManager::stopPolling() {
+    polling = false;
+    if (pollThread.joinable())
+        pollThread.join();
+
+    std::lock_guard<std::mutex> lock(controllersMutex);
+    controllersDropped = true;
+    if (stats.polls > 0) {
+        brls::Logger::info(
+            "InputManager: {} polls at {} Hz, {} sends, poll to send {:.1f} us "
+            "average, {:.1f} us max",
+            stats.polls, stats.rate, stats.sends,
+            stats.sends ? totalLatencyUs / stats.sends : 0,
+            stats.max_latency_us);
+    }
+    if (stats.frames > 0) {
+        brls::Logger::info(
+            "InputManager: {} frames, input took {:.1f} us average, {:.1f} us "
+            "max per frame",
+            stats.frames, totalFrameUs / stats.frames, stats.max_frame_us);
+    }
+    if (stats.motion_samples > 0) {
+        brls::Logger::info("InputManager: {} motion samples, {} sent",
+                           stats.motion_samples, stats.motion_sends);
+    }
+    for (int i = 0; i < _INPUT_KIND_MAX; i++) {
+        const LatencyHistogram& histogram = stats.latency[i];
+        if (histogram.total > 0) {
+            brls::Logger::info(
+                "InputManager: Input kind {} sent {} times, p50 {} us, p99 {} "
+                "us, max {:.1f} us",
+                i, histogram.total, histogram.percentile(0.5),
+                histogram.percentile(0.99), histogram.max_us);
+        }
+    }
+}
 
-    inputManager
-        ->getControllerSensorStateChanged()
-        ->subscribe([this](brls::SensorEvent event) {
-            if (!inputEnabled) return;
-            
-            switch (event.type) {
-                case brls::SensorEventType::ACCEL:
-                    LiSendControllerMotionEvent((uint8_t)event.controllerIndex, LI_MOTION_TYPE_ACCEL, event.data[0], event.data[1], event.data[2]);
-                    break;
-                case brls::SensorEventType::GYRO:
-                    // Convert rad/s to deg/s
-                    LiSendControllerMotionEvent((uint8_t)event.controllerIndex, LI_MOTION_TYPE_GYRO, 
-                        event.data[0] * 57.2957795f, 
-                        event.data[1] * 57.2957795f, 
-                        event.data[2] * 57.2957795f);
-                    break;
-            }
-        });
+InputPollStats MoonlightInputManager::pollStats() {
+    std::lock_guard<std::mutex> lock(controllersMutex);
+    InputPollStats result = stats;
+    if (result.sends > 0)
+        result.average_latency_us = totalLatencyUs / result.sends;
+    if (result.frames > 0)
+        result.average_frame_us = totalFrameUs / result.frames;
+    return result;
+}
+
+void MoonlightInputManager::pollLoop(int rate) {
+    using Clock = std::chrono::steady_clock;
+    auto period = std::chrono::nanoseconds(1000000000 / rate);
+    auto next = Clock::now();
+
+    while (polling) {
+        if (inputEnabled)
+            handleControllers(pollSpecialKey);
+
+        // Skip missed ticks instead of bursting to catch up
+        next += period;
+        auto now = Clock::now();
+        if (next < now)
+            next = now;
+        std::this_thread::sleep_until(next);
+    }
 }
 
 void MoonlightInputManager::reloadButtonMappingLayout() {
@@ -97,6 +166,8 @@ void MoonlightInputManager::reloadButtonMappingLayout() {
             mappingButtons[i] = (brls::ControllerButton)i;
         }
     }
+
+    guideKeys = Settings::instance().guide_key_options().buttons;
 }
 
 void MoonlightInputManager::updateTouchScreenPanDelta(
@@ -109,7 +180,7 @@ void MoonlightInputManager::handleRumble(unsigned short controller,
                                          unsigned short highFreqMotor) {
     brls::Logger::debug("Rumble {} {}", lowFreqMotor, highFreqMotor);
 
-    float rumbleMultiplier = Settings::instance().get_rumble_force();
+    float rumbleMultiplier = Settings::instance().snapshot()->rumble_force;
 
     rumbleCache[controller].lowFreqMotor = lowFreqMotor * rumbleMultiplier;
     rumbleCache[controller].highFreqMotor = highFreqMotor * rumbleMultiplier;
@@ -125,7 +196,7 @@ void MoonlightInputManager::handleRumbleTriggers(uint16_t controllerNumber,
                                                   uint16_t rightTriggerMotor) {
     brls::Logger::debug("Rumble Trigger {} {}", leftTriggerMotor, rightTriggerMotor);
 
-    float rumbleMultiplier = Settings::instance().get_rumble_force();
+    float rumbleMultiplier = Settings::instance().snapshot()->rumble_force;
 
     rumbleCache[controllerNumber].leftTriggerMotor = leftTriggerMotor * rumbleMultiplier;
     rumbleCache[controllerNumber].rightTriggerMotor = rightTriggerMotor * rumbleMultiplier;
@@ -145,31 +216,51 @@ void MoonlightInputManager::dropInput() {
     bool res = true;
     // Drop gamepad state
     GamepadState gamepadState;
-    auto controllersCount = brls::Application::getPlatform()
-                            ->getInputManager()
-                            ->getControllersConnectedCount();
+    auto controllersCount = source->controllersConnected();
+
+    {
+        // Keeps the poll thread from sending live state after the drop
+        std::unique_lock<std::mutex> lock(controllersMutex);
+        controllersDropped = true;
+        for (short i = 0; i < controllersCount; i++)
+            lastGamepadStates[i] = gamepadState;
+
+        std::lock_guard<std::mutex> sendLock(sendMutex);
+        lock.unlock();
 
-    for (short i = 0; i < controllersCount; i++) {
-        res &= LiSendMultiControllerEvent(
-                   i, controllersToMap(), gamepadState.buttonFlags,
-                   gamepadState.leftTrigger, gamepadState.rightTrigger,
-                   gamepadState.leftStickX, gamepadState.leftStickY,
-                   gamepadState.rightStickX, gamepadState.rightStickY) == 0;
+        for (short i = 0; i < controllersCount; i++) {
+            res &= LiSendMultiControllerEvent(
+                       i, controllersToMap(), gamepadState.buttonFlags,
+                       gamepadState.leftTrigger, gamepadState.rightTrigger,
+                       gamepadState.leftStickX, gamepadState.leftStickY,
+                       gamepadState.rightStickX, gamepadState.rightStickY) == 0;
+        }
     }
 
     // Drop touchscreen mouse state
     LiSendMouseButtonEvent(BUTTON_ACTION_RELEASE,BUTTON_MOUSE_LEFT);
 
     // Drop touchscreen state
-    for (auto id: activeTouchIDs) {
-        LiSendTouchEvent(LI_TOUCH_EVENT_CANCEL, id.first, 0, 0, 0, 0, 0, LI_ROT_UNKNOWN);
+    for (auto& touch : activeTouches) {
+        if (touch.active)
+            LiSendTouchEvent(LI_TOUCH_EVENT_CANCEL, touch.id, 0, 0, 0, 0, 0, LI_ROT_UNKNOWN);
+        touch.active = false;
     }
-    activeTouchIDs.clear();
 
-    // Drop keyboard state
-    for (int i = BRLS_KBD_KEY_SPACE; i < BrlsKeyboardScancode::BRLS_KBD_KEY_LAST; i++)  {
-        short vkKey = MoonlightInputManager::glfwKeyToVKKey((BrlsKeyboardScancode)i);
-        LiSendKeyboardEvent(vkKey, KEY_ACTION_UP, 0);
+    // Drop keyboard state, only keys still held need a release
+    for (int i = 0; pressedKeys.any() && i < (int)pressedKeys.size(); i++) {
+        if (pressedKeys[i]) {
+            pressedKeys[i] = false;
+            LiSendKeyboardEvent(i, KEY_ACTION_UP, 0);
+        }
+    }
+
+    mouseDeltaX = 0;
+    mouseDeltaY = 0;
+
+    for (auto& batches : motionBatches) {
+        for (auto& batch : batches)
+            batch = MotionBatch();
     }
 
     inputDropped = res;
@@ -180,9 +271,7 @@ GamepadState MoonlightInputManager::getControllerState(int controllerNum,
     brls::ControllerState rawController{};
     brls::ControllerState controller{};
 
-    brls::Application::setSwapHalfJoyconStickToDpad(Settings::instance().swap_joycon_stick_to_dpad());
-    brls::Application::getPlatform()->getInputManager()->updateControllerState(
-        &rawController, controllerNum);
+    source->controllerState(&rawController, controllerNum);
     controller = mapController(rawController);
 
     // Use axis or button if axis is not available (equals 0)
@@ -190,8 +279,8 @@ GamepadState MoonlightInputManager::getControllerState(int controllerNum,
     float rzAxis = controller.axes[RIGHT_Z] > 0 ? controller.axes[RIGHT_Z] : (controller.buttons[brls::BUTTON_RT] ? 1.f : 0.f);
 
     // Truncate dead zones
-    float leftStickDeadzone = Settings::instance().get_deadzone_stick_left();
-    float rightStickDeadzone = Settings::instance().get_deadzone_stick_right();
+    float leftStickDeadzone = Settings::instance().snapshot()->deadzone_stick_left;
+    float rightStickDeadzone = Settings::instance().snapshot()->deadzone_stick_right;
 
     float leftXAxis = controller.axes[brls::LEFT_X];
     float leftYAxis = controller.axes[brls::LEFT_Y];
@@ -266,7 +355,6 @@ GamepadState MoonlightInputManager::getControllerState(int controllerNum,
     SET_GAME_PAD_STATE(LS_CLK_FLAG, brls::BUTTON_LSB);
     SET_GAME_PAD_STATE(RS_CLK_FLAG, brls::BUTTON_RSB);
 
-    auto guideKeys = Settings::instance().guide_key_options().buttons;
     bool guideCombo = !guideKeys.empty();
     for (auto key : guideKeys)
         guideCombo &= controller.buttons[key];
@@ -283,59 +371,258 @@ GamepadState MoonlightInputManager::getControllerState(int controllerNum,
 }
 
 void MoonlightInputManager::handleControllers(bool specialKey) {
-    static int lastControllerCount = 0;
+    struct ControllerChange {
+        int controller;
+        GamepadState state;
+        std::chrono::steady_clock::time_point sampled;
+    };
+
+    std::unique_lock<std::mutex> lock(controllersMutex);
+    if (controllersDropped)
+        return;
 
-    auto controllersCount = brls::Application::getPlatform()
-                            ->getInputManager()
-                            ->getControllersConnectedCount();
+    auto controllersCount = source->controllersConnected();
 
     short mappedControllersCount = controllersToMap();
+    stats.polls++;
 
+    bool arrived = false;
+    std::vector<ControllerChange> changes;
     for (int i = 0; i < controllersCount; i++) {
+        auto sampled = std::chrono::steady_clock::now();
         GamepadState gamepadState = getControllerState(i, specialKey);
 
         if (!gamepadState.is_equal(lastGamepadStates[i])) {
             lastGamepadStates[i] = gamepadState;
+            changes.push_back({i, gamepadState, sampled});
 
             if (lastControllerCount != controllersCount) {
                 lastControllerCount = controllersCount;
-                
-                for (int i = 0; i < controllersCount; i++) {
-                    Logger::debug("StreamingView: send features message for controller #{}", i);
-                    LiSendControllerArrivalEvent(i, mappedControllersCount, LI_CTYPE_UNKNOWN, 0, LI_CCAP_RUMBLE | LI_CCAP_ACCEL | LI_CCAP_GYRO);
-                }
+                arrived = true;
             }
+        }
+    }
 
-            if (LiSendMultiControllerEvent(
-                    i, mappedControllersCount, gamepadState.buttonFlags,
-                    gamepadState.leftTrigger, gamepadState.rightTrigger,
-                    gamepadState.leftStickX, gamepadState.leftStickY,
-                    gamepadState.rightStickX, gamepadState.rightStickY) != 0)
-                brls::Logger::info("StreamingView: error sending input data");
+    if (changes.empty())
+        return;
+
+    // Sends run outside controllersMutex so the main thread never waits on
+    // them. sendMutex is taken first, so a drop that comes in now still
+    // sends its release after this state.
+    std::unique_lock<std::mutex> sendLock(sendMutex);
+    lock.unlock();
+
+    if (arrived) {
+        for (int i = 0; i < controllersCount; i++) {
+            Logger::debug("StreamingView: send features message for controller #{}", i);
+            LiSendControllerArrivalEvent(i, mappedControllersCount, LI_CTYPE_UNKNOWN, 0, LI_CCAP_RUMBLE | LI_CCAP_ACCEL | LI_CCAP_GYRO);
         }
     }
+
+    std::vector<double> latencies;
+    for (const ControllerChange& change : changes) {
+        const GamepadState& gamepadState = change.state;
+        if (LiSendMultiControllerEvent(
+                change.controller, mappedControllersCount,
+                gamepadState.buttonFlags, gamepadState.leftTrigger,
+                gamepadState.rightTrigger, gamepadState.leftStickX,
+                gamepadState.leftStickY, gamepadState.rightStickX,
+                gamepadState.rightStickY) != 0)
+            brls::Logger::info("StreamingView: error sending input data");
+
+        latencies.push_back(std::chrono::duration<double, std::micro>(
+                                std::chrono::steady_clock::now() - change.sampled)
+                                .count());
+    }
+
+    sendLock.unlock();
+    lock.lock();
+    for (double latency : latencies) {
+        stats.sends++;
+        totalLatencyUs += latency;
+        stats.max_latency_us = std::max(stats.max_latency_us, latency);
+        stats.latency[INPUT_GAMEPAD].add(latency);
+    }
 }
 
 void MoonlightInputManager::handleInput(bool ignoreTouch) {
+    auto start = std::chrono::steady_clock::now();
+    handleFrameInput(ignoreTouch);
+    double elapsed = std::chrono::duration<double, std::micro>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+
+    std::lock_guard<std::mutex> lock(controllersMutex);
+    stats.frames++;
+    totalFrameUs += elapsed;
+    stats.max_frame_us = std::max(stats.max_frame_us, elapsed);
+}
+
+void MoonlightInputManager::recordLatency(
+    InputKind kind, std::chrono::steady_clock::time_point sampled) {
+    double latency = std::chrono::duration<double, std::micro>(
+                         std::chrono::steady_clock::now() - sampled)
+                         .count();
+
+    std::lock_guard<std::mutex> lock(controllersMutex);
+    stats.latency[kind].add(latency);
+}
+
+void MoonlightInputManager::sendKeyboardEvent(short vkKey, bool pressed,
+                                              char modifiers) {
+    // Key events are delivered one by one, so they are sampled on arrival
+    auto sampled = std::chrono::steady_clock::now();
+    if (vkKey >= 0 && vkKey < (short)pressedKeys.size())
+        pressedKeys[vkKey] = pressed;
+    LiSendKeyboardEvent(vkKey, pressed ? KEY_ACTION_DOWN : KEY_ACTION_UP,
+                        modifiers);
+    recordLatency(INPUT_KEYBOARD, sampled);
+}
+
+void MoonlightInputManager::addMouseMotion(brls::Point offset) {
+    if (!inputEnabled || (offset.x == 0 && offset.y == 0))
+        return;
+
+    float multiplier =
+        (float)Settings::instance().snapshot()->mouse_speed_multiplier /
+            100.f * 1.5f +
+        0.5f;
+
+    // Sent once per frame by handleInput
+    if (!inputDropped) {
+        if (mouseDeltaX == 0 && mouseDeltaY == 0)
+            mouseMotionSampled = std::chrono::steady_clock::now();
+        mouseDeltaX += offset.x * multiplier;
+        mouseDeltaY += offset.y * multiplier;
+    }
+}
+
+void MoonlightInputManager::setTouchActive(uint32_t id, bool active, float x,
+                                           float y) {
+    ActiveTouch* unused = nullptr;
+    for (auto& touch : activeTouches) {
+        if (touch.active && touch.id == id) {
+            touch = {id, active, x, y};
+            return;
+        }
+        if (!touch.active && !unused)
+            unused = &touch;
+    }
+
+    if (active && unused)
+        *unused = {id, true, x, y};
+}
+
+bool MoonlightInputManager::touchMoved(uint32_t id, float x, float y) {
+    for (auto& touch : activeTouches) {
+        if (touch.active && touch.id == id)
+            return std::fabs(x - touch.x) >= touch_move_threshold ||
+                   std::fabs(y - touch.y) >= touch_move_threshold;
+    }
+    return true;
+}
+
+void MoonlightInputManager::handleMotion(int controller, uint8_t type, float x,
+                                         float y, float z) {
+    if (controller < 0 || controller >= GAMEPADS_MAX || inputDropped)
+        return;
+
+    // A sensor event raised while the poll thread reads a controller is
+    // handled on the main thread, the batches belong to it
+    if (polling && std::this_thread::get_id() != mainThread) {
+        brls::sync([this, controller, type, x, y, z] {
+            handleMotion(controller, type, x, y, z);
+        });
+        return;
+    }
+
+    MotionBatch& batch = motionBatches[controller][type == LI_MOTION_TYPE_GYRO];
+    if (batch.samples == 0)
+        batch.firstSample = std::chrono::steady_clock::now();
+    batch.sum[0] += x;
+    batch.sum[1] += y;
+    batch.sum[2] += z;
+    batch.samples++;
+
+    {
+        std::lock_guard<std::mutex> lock(controllersMutex);
+        stats.motion_samples++;
+    }
+
+    flushMotion(controller, type);
+}
+
+void MoonlightInputManager::flushMotion(int controller, uint8_t type) {
+    MotionBatch& batch = motionBatches[controller][type == LI_MOTION_TYPE_GYRO];
+    if (batch.samples == 0)
+        return;
+
+    auto now = std::chrono::steady_clock::now();
+    if (now - batch.lastFlush < motion_send_interval)
+        return;
+
+    float average[3];
+    bool changed = false;
+    float threshold = type == LI_MOTION_TYPE_GYRO ? gyro_send_threshold
+                                                  : accel_send_threshold;
+    for (int i = 0; i < 3; i++) {
+        average[i] = batch.sum[i] / batch.samples;
+        changed |= std::fabs(average[i] - batch.sent[i]) >= threshold;
+        batch.sum[i] = 0;
+    }
+    batch.samples = 0;
+    batch.lastFlush = now;
+
+    if (!changed)
+        return;
+
+    LiSendControllerMotionEvent((uint8_t)controller, type, average[0],
+                                average[1], average[2]);
+    recordLatency(INPUT_MOTION, batch.firstSample);
+    std::copy(average, average + 3, batch.sent);
+
+    std::lock_guard<std::mutex> lock(controllersMutex);
+    stats.motion_sends++;
+}
+
+void MoonlightInputManager::flushMouseMotion() {
+    short x = (short)std::clamp(mouseDeltaX, -32767.f, 32767.f);
+    short y = (short)std::clamp(mouseDeltaY, -32767.f, 32767.f);
+    if (x == 0 && y == 0)
+        return;
+
+    mouseDeltaX -= x;
+    mouseDeltaY -= y;
+    LiSendMouseMoveEvent(x, y);
+    recordLatency(INPUT_MOUSE_MOTION, mouseMotionSampled);
+    mouseMotionSampled = std::chrono::steady_clock::now();
+}
+
+void MoonlightInputManager::handleFrameInput(bool ignoreTouch) {
+    frameSampled = std::chrono::steady_clock::now();
     inputDropped = false;
+    {
+        std::lock_guard<std::mutex> lock(controllersMutex);
+        controllersDropped = false;
+    }
+    brls::Application::setSwapHalfJoyconStickToDpad(Settings::instance().swap_joycon_stick_to_dpad());
     static brls::ControllerState rawController;
     static brls::ControllerState controller;
     static brls::RawMouseState mouse;
 
-    brls::Application::getPlatform()
-            ->getInputManager()
-            ->updateUnifiedControllerState(&rawController);
-    brls::Application::getPlatform()->getInputManager()->updateMouseStates(
-            &mouse);
+    source->unifiedControllerState(&rawController);
+    source->mouseState(&mouse);
     controller = mapController(rawController);
 
-    std::vector<brls::RawTouchState> states;
-    brls::Application::getPlatform()->getInputManager()->updateTouchStates(&states);
+    touchStates.clear();
+    source->rawTouchStates(&touchStates);
 
     //Do not use gamepad for mouse controll assist if touchscreen mode enabled
-    bool specialKey = !ignoreTouch && !Settings::instance().touchscreen_mouse_mode() && states.size() == 1;
+    bool specialKey = !ignoreTouch && !Settings::instance().snapshot()->touchscreen_mouse_mode && touchStates.size() == 1;
 
-    handleControllers(specialKey);
+    pollSpecialKey = specialKey;
+    if (!polling)
+        handleControllers(specialKey);
 
     float stickScrolling =
             specialKey
@@ -345,7 +632,16 @@ void MoonlightInputManager::handleInput(bool ignoreTouch) {
     static MouseStateS lastMouseState;
 
     MouseStateS mouseState;
-    if (!Settings::instance().touchscreen_mouse_mode()) {
+    // Pointer motion goes out before this frame's button changes
+    flushMouseMotion();
+
+    // Sends what is left over if a sensor went quiet mid batch
+    for (int i = 0; i < GAMEPADS_MAX; i++) {
+        flushMotion(i, LI_MOTION_TYPE_ACCEL);
+        flushMotion(i, LI_MOTION_TYPE_GYRO);
+    }
+
+    if (!Settings::instance().snapshot()->touchscreen_mouse_mode) {
         mouseState = {
                 .scroll_y = stickScrolling,
                 .l_pressed = (specialKey && controller.buttons[brls::BUTTON_RT]) || mouse.leftButton,
@@ -361,16 +657,17 @@ void MoonlightInputManager::handleInput(bool ignoreTouch) {
         };
     }
 
-    if (Settings::instance().swap_mouse_scroll())
+    if (Settings::instance().snapshot()->swap_mouse_scroll)
         mouseState.scroll_y *= -1;
 
     if (mouseState.l_pressed != lastMouseState.l_pressed) {
         lastMouseState.l_pressed = mouseState.l_pressed;
-        auto lb = Settings::instance().swap_mouse_keys() ? BUTTON_MOUSE_RIGHT
+        auto lb = Settings::instance().snapshot()->swap_mouse_keys ? BUTTON_MOUSE_RIGHT
                                                          : BUTTON_MOUSE_LEFT;
         LiSendMouseButtonEvent(mouseState.l_pressed ? BUTTON_ACTION_PRESS
                                                     : BUTTON_ACTION_RELEASE,
                                lb);
+        recordLatency(INPUT_MOUSE_BUTTON, frameSampled);
         if (!mouseState.l_pressed)
             Logger::debug("Release key lmb");
     }
@@ -380,15 +677,17 @@ void MoonlightInputManager::handleInput(bool ignoreTouch) {
         LiSendMouseButtonEvent(mouseState.m_pressed ? BUTTON_ACTION_PRESS
                                                     : BUTTON_ACTION_RELEASE,
                                BUTTON_MOUSE_MIDDLE);
+        recordLatency(INPUT_MOUSE_BUTTON, frameSampled);
     }
 
     if (mouseState.r_pressed != lastMouseState.r_pressed) {
         lastMouseState.r_pressed = mouseState.r_pressed;
-        auto rb = Settings::instance().swap_mouse_keys() ? BUTTON_MOUSE_LEFT
+        auto rb = Settings::instance().snapshot()->swap_mouse_keys ? BUTTON_MOUSE_LEFT
                                                          : BUTTON_MOUSE_RIGHT;
         LiSendMouseButtonEvent(mouseState.r_pressed ? BUTTON_ACTION_PRESS
                                                     : BUTTON_ACTION_RELEASE,
                                rb);
+        recordLatency(INPUT_MOUSE_BUTTON, frameSampled);
     }
 
     std::chrono::high_resolution_clock::time_point timeNow =
@@ -406,25 +705,27 @@ void MoonlightInputManager::handleInput(bool ignoreTouch) {
         LiSendScrollEvent(mouseState.scroll_y > 0 ? 1 : -1);
     }
 
-    if (!Settings::instance().touchscreen_mouse_mode()) {
+    if (!Settings::instance().snapshot()->touchscreen_mouse_mode) {
         // Do not process touch events, useful if onscreen keyboard is presented
         if (ignoreTouch) { return; }
 
         if (panStatus.has_value()) {
             float multiplier =
-                    Settings::instance().get_mouse_speed_multiplier() / 100.f * 1.5f +
+                    Settings::instance().snapshot()->mouse_speed_multiplier / 100.f * 1.5f +
                     0.5f;
-            LiSendMouseMoveEvent(-panStatus->delta.x * multiplier,
-                                 -panStatus->delta.y * multiplier);
+            if (mouseDeltaX == 0 && mouseDeltaY == 0)
+                mouseMotionSampled = frameSampled;
+            mouseDeltaX -= panStatus->delta.x * multiplier;
+            mouseDeltaY -= panStatus->delta.y * multiplier;
+            flushMouseMotion();
             panStatus.reset();
         }
     } else {
         uint8_t eventType;
 
-        auto touches = brls::Application::currentTouchState;
+        auto touches = source->streamTouches();
         for (int i = 0; i < touches.size(); i++) {
             auto touch = touches[i];
-            if (touch.view && touch.view->hasParent() && dynamic_cast<StreamingView*>(touch.view->getParent()) == nullptr) return;
 
             switch (touch.phase) {
                 case TouchPhase::START:
@@ -441,15 +742,21 @@ void MoonlightInputManager::handleInput(bool ignoreTouch) {
                     break;
             }
 
-            if (touch.phase != TouchPhase::NONE) {
-                activeTouchIDs.insert(std::pair(touch.fingerId, true));
-            } else {
-                activeTouchIDs.erase(touch.fingerId);
-            }
+            // A resting finger is reported every frame, only send real moves
+            if (touch.phase == TouchPhase::STAY &&
+                !touchMoved(touch.fingerId, touch.position.x, touch.position.y))
+                continue;
+
+            setTouchActive(touch.fingerId,
+                           touch.phase == TouchPhase::START ||
+                               touch.phase == TouchPhase::STAY,
+                           touch.position.x, touch.position.y);
+
+            int touchResult = LiSendTouchEvent(eventType, touch.fingerId, touch.position.x / (float) Application::contentWidth,
+                                               touch.position.y / (float) Application::contentHeight, 0, 0, 0, LI_ROT_UNKNOWN);
+            recordLatency(INPUT_TOUCH, frameSampled);
 
-            if (LiSendTouchEvent(eventType, touch.fingerId, touch.position.x / (float) Application::contentWidth,
-                                 touch.position.y / (float) Application::contentHeight, 0, 0, 0, LI_ROT_UNKNOWN) ==
-                LI_ERR_UNSUPPORTED && i == 0) {
+            if (touchResult == LI_ERR_UNSUPPORTED && i == 0) {
                 // Fallback to move cursor and click if touch unsupported
                 if (touch.phase != TouchPhase::NONE) {
                     LiSendMousePositionEvent(touch.position.x, touch.position.y, Application::contentWidth,
@@ -467,9 +774,7 @@ void MoonlightInputManager::handleInput(bool ignoreTouch) {
 }
 
 short MoonlightInputManager::controllersToMap() {
-    switch (brls::Application::getPlatform()
-                ->getInputManager()
-                ->getControllersConnectedCount()) {
+    switch (source->controllersConnected()) {
     case 0:
         return 0x0;
     case 1:
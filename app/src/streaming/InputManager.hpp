@@ -9,8 +9,24 @@
 
 #include "Singleton.hpp"
 #include "keyboard_view.hpp"
+#include <atomic>
+#include <bitset>
 #include <borealis.hpp>
+#include <chrono>
+#include <memory>
+#include <mutex>
 #include <optional>
+#include <thread>
+#include <vector>
+
+#if defined(__SWITCH__) || defined(__SDL2__)
+// Experimental and left out of the settings UI, off unless input_poll_rate is
+// set in settings.json. borealis does not promise that its input managers can
+// be read off the main thread; the Switch one samples HID shared memory and
+// the SDL one takes the joystick lock, but running next to the main loop has
+// not been proven on hardware yet.
+#define INPUT_POLL_THREAD
+#endif
 
 // Moonlight ready gamepad
 struct GamepadState {
@@ -40,6 +56,47 @@ struct MouseStateS {
     bool r_pressed = 0;
 };
 
+enum InputKind {
+    INPUT_GAMEPAD,
+    INPUT_KEYBOARD,
+    INPUT_MOUSE_BUTTON,
+    INPUT_MOUSE_MOTION,
+    INPUT_TOUCH,
+    INPUT_MOTION,
+    _INPUT_KIND_MAX
+};
+
+// Power of two microsecond buckets: bucket 0 is under 1 us, bucket i holds
+// [2^(i-1), 2^i) us and the last one everything above
+struct LatencyHistogram {
+    static const int buckets = 16;
+    uint32_t counts[buckets] = {};
+    uint64_t total = 0;
+    double max_us = 0;
+
+    void add(double us);
+    // Upper bound of the bucket holding the p-th fraction of samples
+    double percentile(double p) const;
+};
+
+struct InputPollStats {
+    int rate = 0; // Hz, 0 while sampled once per frame
+    uint64_t polls = 0;
+    uint64_t sends = 0;
+    // From reading a controller to LiSendMultiControllerEvent returning
+    double average_latency_us = 0;
+    double max_latency_us = 0;
+    // Main thread time spent in handleInput
+    uint64_t frames = 0;
+    double average_frame_us = 0;
+    double max_frame_us = 0;
+    // Sensor samples received and motion events actually sent
+    uint64_t motion_samples = 0;
+    uint64_t motion_sends = 0;
+    // From sampling an input to its LiSend* call returning
+    LatencyHistogram latency[_INPUT_KIND_MAX];
+};
+
 struct RumbleValues {
     unsigned short lowFreqMotor;
     unsigned short highFreqMotor;
@@ -47,9 +104,32 @@ struct RumbleValues {
     uint16_t rightTriggerMotor;
 };
 
+// Where the manager samples controllers, mouse and touches from. The app
+// reads the borealis platform, app/tools/input_loopback.cpp feeds scripted
+// states instead.
+class InputSource {
+  public:
+    virtual ~InputSource() = default;
+
+    virtual int controllersConnected() = 0;
+    virtual void controllerState(brls::ControllerState* state,
+                                 int controller) = 0;
+    virtual void unifiedControllerState(brls::ControllerState* state) = 0;
+    virtual void mouseState(brls::RawMouseState* state) = 0;
+    virtual void rawTouchStates(std::vector<brls::RawTouchState>* states) = 0;
+    // Touches meant for the stream, up to the first one that landed on an
+    // overlay view
+    virtual std::vector<brls::TouchState> streamTouches() = 0;
+};
+
 class MoonlightInputManager : public Singleton<MoonlightInputManager> {
   public:
+    // Samples the borealis platform and subscribes to its input events,
+    // defined in PlatformInputSource.cpp
     MoonlightInputManager();
+    // Samples only the given source, no platform events are subscribed
+    explicit MoonlightInputManager(std::unique_ptr<InputSource> source);
+    ~MoonlightInputManager();
     void dropInput();
     void handleInput(bool ignoreTouch = false);
     void handleRumble(unsigned short controller, unsigned short lowFreqMotor, unsigned short highFreqMotor);
@@ -57,23 +137,86 @@ class MoonlightInputManager : public Singleton<MoonlightInputManager> {
     void updateTouchScreenPanDelta(brls::PanGestureStatus panStatus);
     void reloadButtonMappingLayout();
     void setInputEnabled(bool enabled) { inputEnabled = enabled; }
+
+    // Samples controllers on a dedicated thread at the rate from Settings,
+    // handleInput then leaves them alone. Does nothing if the rate is 0.
+    void startPolling();
+    void stopPolling();
+    InputPollStats pollStats();
+
+    // Sends a key and remembers it as held until released or dropped
+    void sendKeyboardEvent(short vkKey, bool pressed, char modifiers);
+    // Adds pointer motion, sent once per frame by handleInput
+    void addMouseMotion(brls::Point offset);
     static void leftMouseClick();
     static void rightMouseClick();
 
   private:
+    std::unique_ptr<InputSource> source;
     RumbleValues rumbleCache[GAMEPADS_MAX];
     GamepadState lastGamepadStates[GAMEPADS_MAX];
     brls::ControllerButton mappingButtons[brls::_BUTTON_MAX];
     std::optional<brls::PanGestureStatus> panStatus;
-    std::map<uint32_t, bool> activeTouchIDs;
-    bool inputDropped = false;
-    bool inputEnabled = true;
+    struct ActiveTouch {
+        uint32_t id = 0;
+        bool active = false;
+        float x = 0;
+        float y = 0;
+    };
+
+    // Sensor samples averaged between sends, per controller and sensor
+    struct MotionBatch {
+        float sum[3] = {};
+        int samples = 0;
+        float sent[3] = {};
+        std::chrono::steady_clock::time_point firstSample;
+        std::chrono::steady_clock::time_point lastFlush;
+    };
+
+    // Virtual key codes are a single byte
+    std::bitset<256> pressedKeys;
+    ActiveTouch activeTouches[10];
+    std::vector<brls::RawTouchState> touchStates;
+    // Mouse motion accumulated between frames, fractions carry over
+    MotionBatch motionBatches[GAMEPADS_MAX][2];
+    float mouseDeltaX = 0;
+    float mouseDeltaY = 0;
+    std::chrono::steady_clock::time_point mouseMotionSampled;
+    std::chrono::steady_clock::time_point frameSampled;
+    std::vector<brls::ControllerButton> guideKeys;
+    std::atomic<bool> inputDropped = false;
+    std::atomic<bool> inputEnabled = true;
+
+    // Guards controller state shared with the poll thread
+    std::mutex controllersMutex;
+    // Orders controller sends between the poll thread and dropInput, taken
+    // while controllersMutex is still held
+    std::mutex sendMutex;
+    int lastControllerCount = 0;
+    InputPollStats stats;
+    double totalLatencyUs = 0;
+    double totalFrameUs = 0;
+
+    std::thread pollThread;
+    std::thread::id mainThread;
+    std::atomic<bool> polling = false;
+    std::atomic<bool> pollSpecialKey = false;
+    bool controllersDropped = true;
 
     brls::ControllerState mapController(brls::ControllerState controller);
     static short glfwKeyToVKKey(brls::BrlsKeyboardScancode key);
 
     GamepadState getControllerState(int controllerNum, bool specialKey);
     void handleControllers(bool specialKey);
+    void handleFrameInput(bool ignoreTouch);
+    void setTouchActive(uint32_t id, bool active, float x, float y);
+    bool touchMoved(uint32_t id, float x, float y);
+    void handleMotion(int controller, uint8_t type, float x, float y, float z);
+    void flushMotion(int controller, uint8_t type);
+    void flushMouseMotion();
+    void recordLatency(InputKind kind,
+                       std::chrono::steady_clock::time_point sampled);
+    void pollLoop(int rate);
 
-    static short controllersToMap();
+    short controllersToMap();
 };
@@ -0,0 +1,368 @@
+//
+//  MdnsBrowser.cpp
+//  Moonlight
+//
+
+#ifndef MULTICAST_DISABLED
+
+#include "MdnsBrowser.hpp"
+#include <algorithm>
+#include <cctype>
+
+#if defined(_WIN32)
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#define mdns_poll WSAPoll
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#define mdns_poll poll
+#endif
+
+#if defined(__SWITCH__)
+// TODO: Remove when presented in LibNX
+struct ipv6_mreq {
+	struct in6_addr ipv6mr_multiaddr;
+	unsigned int    ipv6mr_interface;
+};
+#endif
+
+extern "C" {
+#include <mdns.h>
+}
+
+using namespace brls::literals;
+
+static const char service_name[] = "_nvstream._tcp.local";
+static const std::chrono::seconds max_query_interval(60);
+
+static std::string normalize_name(mdns_string_t name) {
+    std::string result(name.str, name.length);
+    if (!result.empty() && result.back() == '.')
+        result.pop_back();
+    return result;
+}
+
+static std::string lowercase(std::string string) {
+    std::transform(string.begin(), string.end(), string.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    return string;
+}
+
+static std::string ip_string(const struct sockaddr* addr) {
+    char buffer[INET6_ADDRSTRLEN] = {};
+    if (addr->sa_family == AF_INET) {
+        inet_ntop(AF_INET, &((struct sockaddr_in*)addr)->sin_addr, buffer,
+                  sizeof(buffer));
+    } else if (addr->sa_family == AF_INET6) {
+        inet_ntop(AF_INET6, &((struct sockaddr_in6*)addr)->sin6_addr, buffer,
+                  sizeof(buffer));
+    }
+    return buffer;
+}
+
+static int mdns_record_callback(int sock, const struct sockaddr* from,
+                                size_t addrlen, mdns_entry_type_t entry,
+                                uint16_t query_id, uint16_t type,
+                                uint16_t rclass, uint32_t ttl, const void* data,
+                                size_t size, size_t name_offset,
+                                size_t name_length, size_t record_offset,
+                                size_t record_length, void* user_data) {
+    char buffer[256];
+    mdns_string_t name =
+        mdns_string_extract(data, size, &name_offset, buffer, sizeof(buffer));
+
+    ((MdnsBrowser*)user_data)
+        ->record(from, type, ttl, normalize_name(name), data, size,
+                 record_offset, record_length);
+    return 0;
+}
+
+MdnsBrowser::~MdnsBrowser() { stop(); }
+
+void MdnsBrowser::start() {
+    if (running) {
+        // Already browsing, just ask again right away
+        requery = true;
+    } else {
+        if (thread.joinable())
+            thread.join();
+
+        running = true;
+        browseStart = Clock::now();
+        thread = std::thread([this] { loop(); });
+    }
+
+    brls::sync([this] { getHostsUpdateEvent()->fire(hosts); });
+}
+
+void MdnsBrowser::stop() {
+    running = false;
+    if (thread.joinable())
+        thread.join();
+}
+
+void MdnsBrowser::record(const struct sockaddr* from, uint16_t type,
+                         uint32_t ttl, const std::string& name,
+                         const void* data, size_t size, size_t recordOffset,
+                         size_t recordLength) {
+    char buffer[256];
+    auto now = Clock::now();
+    auto expires = now + std::chrono::seconds(ttl);
+
+    if (type == MDNS_RECORDTYPE_PTR) {
+        if (lowercase(name) != service_name)
+            return;
+
+        std::string instance = normalize_name(mdns_record_parse_ptr(
+            data, size, recordOffset, recordLength, buffer, sizeof(buffer)));
+
+        auto it = services.find(instance);
+        if (it == services.end()) {
+            if (ttl == 0)
+                return;
+
+            brls::Logger::info(
+                "MdnsBrowser: Saw {} {} ms after browsing started", instance,
+                std::chrono::duration_cast<std::chrono::milliseconds>(
+                    now - browseStart)
+                    .count());
+
+            it = services.emplace(instance, Service()).first;
+            it->second.firstSeen = now;
+        }
+
+        it->second.ttl = std::chrono::seconds(ttl);
+        it->second.expires = expires;
+
+        // Every answer gives a host that was still booting another try
+        if (it->second.probeFailed) {
+            it->second.probeFailed = false;
+            it->second.address.clear();
+        }
+        if (from->sa_family == AF_INET)
+            it->second.sender = ip_string(from);
+    } else if (type == MDNS_RECORDTYPE_SRV) {
+        auto it = services.find(name);
+        if (it == services.end())
+            return;
+
+        mdns_record_srv_t srv = mdns_record_parse_srv(
+            data, size, recordOffset, recordLength, buffer, sizeof(buffer));
+        it->second.target = lowercase(normalize_name(srv.name));
+    } else if (type == MDNS_RECORDTYPE_A) {
+        struct sockaddr_in addr;
+        mdns_record_parse_a(data, size, recordOffset, recordLength, &addr);
+
+        Address& address = addresses[lowercase(name)];
+        address.ipv4 = ip_string((struct sockaddr*)&addr);
+        address.expires = std::max(address.expires, expires);
+    } else if (type == MDNS_RECORDTYPE_AAAA) {
+        struct sockaddr_in6 addr;
+        mdns_record_parse_aaaa(data, size, recordOffset, recordLength, &addr);
+
+        Address& address = addresses[lowercase(name)];
+        address.ipv6 = ip_string((struct sockaddr*)&addr);
+        address.expires = std::max(address.expires, expires);
+    }
+}
+
+void MdnsBrowser::loop() {
+    int sockets[2] = {mdns_socket_open_ipv4(nullptr),
+                      mdns_socket_open_ipv6(nullptr)};
+
+    if (sockets[0] < 0 && sockets[1] < 0) {
+        brls::Logger::error("MdnsBrowser: Failed to open sockets");
+        brls::sync([this] {
+            hosts = GSResult<std::vector<Host>>::failure(
+                "error/unknown_error"_i18n);
+            getHostsUpdateEvent()->fire(hosts);
+        });
+        running = false;
+        return;
+    }
+
+    std::vector<char> buffer(2048);
+    std::chrono::seconds interval(1);
+    auto nextQuery = Clock::now();
+    auto lastQuery = Clock::time_point();
+
+    while (running) {
+        auto now = Clock::now();
+
+        if (requery.exchange(false)) {
+            interval = std::chrono::seconds(1);
+            nextQuery = now;
+        }
+
+        // Back off between queries, but ask again before a cached
+        // instance runs out
+        for (const auto& [instance, service] : services) {
+            auto refresh = service.expires - service.ttl / 5;
+            if (refresh > lastQuery)
+                nextQuery = std::min(nextQuery, refresh);
+        }
+
+        if (now >= nextQuery) {
+            for (int sock : sockets) {
+                if (sock >= 0 &&
+                    mdns_query_send(sock, MDNS_RECORDTYPE_PTR,
+                                    MDNS_STRING_CONST(service_name),
+                                    buffer.data(), buffer.size(), 0) < 0) {
+                    brls::Logger::error("MdnsBrowser: Failed to send query");
+                }
+            }
+
+            lastQuery = now;
+            nextQuery = now + interval;
+            interval = std::min(interval * 2, max_query_interval);
+        }
+
+        struct pollfd fds[2];
+        int count = 0;
+        for (int sock : sockets) {
+            if (sock >= 0)
+                fds[count++] = {sock, POLLIN, 0};
+        }
+
+        auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(
+            nextQuery - Clock::now());
+        int timeout = (int)std::clamp<long long>(wait.count(), 0, 250);
+
+        if (mdns_poll(fds, count, timeout) > 0) {
+            for (int i = 0; i < count; i++) {
+                if (fds[i].revents & POLLIN)
+                    mdns_query_recv(fds[i].fd, buffer.data(), buffer.size(),
+                                    mdns_record_callback, this, 0);
+            }
+        }
+
+        expire();
+        resolve();
+    }
+
+    for (int sock : sockets) {
+        if (sock >= 0)
+            mdns_socket_close(sock);
+    }
+}
+
+void MdnsBrowser::resolve() {
+    {
+        std::lock_guard<std::mutex> guard(failedMutex);
+        for (const auto& [instance, address] : failedProbes) {
+            auto it = services.find(instance);
+            if (it != services.end() && it->second.address == address)
+                it->second.probeFailed = true;
+        }
+        failedProbes.clear();
+    }
+
+    for (auto& [instance, service] : services) {
+        // gs_init cannot take IPv6 literals yet, so AAAA records are only
+        // kept for completeness and IPv4 is preferred
+        std::string address = service.sender;
+        auto it = addresses.find(service.target);
+        if (it != addresses.end() && !it->second.ipv4.empty())
+            address = it->second.ipv4;
+
+        if (address.empty() || address == service.address)
+            continue;
+
+        bool known = !service.address.empty();
+        service.address = address;
+
+        if (known) {
+            brls::sync([this, instance, address] {
+                if (found.count(instance)) {
+                    found[instance].address = address;
+                    publish();
+                }
+            });
+            continue;
+        }
+
+        auto firstSeen = service.firstSeen;
+        brls::sync([this, instance] { removed.erase(instance); });
+        brls::async([this, instance, address, firstSeen] {
+            SERVER_DATA server_data;
+            int status = gs_init(&server_data, address);
+
+            auto now = Clock::now();
+            brls::Logger::info(
+                "MdnsBrowser: {} at {} answered serverinfo in {} ms ({} ms "
+                "after browsing started)",
+                instance, address,
+                std::chrono::duration_cast<std::chrono::milliseconds>(
+                    now - firstSeen)
+                    .count(),
+                std::chrono::duration_cast<std::chrono::milliseconds>(
+                    now - browseStart)
+                    .count());
+
+            if (status != GS_OK) {
+                std::lock_guard<std::mutex> guard(failedMutex);
+                failedProbes[instance] = address;
+            }
+
+            brls::sync([this, instance, address, status, server_data] {
+                if (status != GS_OK || removed.count(instance))
+                    return;
+
+                Host host;
+                host.address = address;
+                host.hostname = server_data.hostname;
+                host.mac = server_data.mac;
+                host.uniqueid = server_data.uniqueid;
+                found[instance] = host;
+                publish();
+            });
+        });
+    }
+}
+
+void MdnsBrowser::expire() {
+    auto now = Clock::now();
+
+    for (auto it = services.begin(); it != services.end();) {
+        if (it->second.expires > now) {
+            it++;
+            continue;
+        }
+
+        brls::Logger::info("MdnsBrowser: {} went away", it->first);
+        std::string instance = it->first;
+        brls::sync([this, instance] {
+            removed.insert(instance);
+            if (found.erase(instance))
+                publish();
+        });
+        it = services.erase(it);
+    }
+
+    for (auto it = addresses.begin(); it != addresses.end();) {
+        if (it->second.expires <= now)
+            it = addresses.erase(it);
+        else
+            it++;
+    }
+}
+
+void MdnsBrowser::publish() {
+    std::vector<Host> result;
+    std::set<std::string> seen;
+
+    // A host announcing itself under several names is still one host
+    for (const auto& [instance, host] : found) {
+        std::string key = host.uniqueid.empty() ? host.address : host.uniqueid;
+        if (seen.insert(key).second)
+            result.push_back(host);
+    }
+
+    hosts = GSResult<std::vector<Host>>::success(result);
+    getHostsUpdateEvent()->fire(hosts);
+}
+
+#endif
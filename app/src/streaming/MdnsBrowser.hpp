@@ -0,0 +1,92 @@
+//
+//  MdnsBrowser.hpp
+//  Moonlight
+//
+
+#pragma once
+
+#ifndef MULTICAST_DISABLED
+
+#include "GameStreamClient.hpp"
+#include "Settings.hpp"
+#include "Singleton.hpp"
+#include <atomic>
+#include <borealis.hpp>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Keeps browsing _nvstream._tcp.local on a background thread. Records are
+// cached by TTL, every service instance is probed with serverinfo once (or
+// again with its next answer if that failed) and the resulting hosts are
+// published through getHostsUpdateEvent.
+class MdnsBrowser : public Singleton<MdnsBrowser> {
+  public:
+    ~MdnsBrowser();
+
+    brls::Event<GSResult<std::vector<Host>>>* getHostsUpdateEvent() {
+        return &hostsUpdateEvent;
+    }
+
+    GSResult<std::vector<Host>> getHosts() { return hosts; }
+
+    void start();
+    void stop();
+
+    // Called from the mDNS record callback on the browser thread
+    void record(const struct sockaddr* from, uint16_t type, uint32_t ttl,
+                const std::string& name, const void* data, size_t size,
+                size_t recordOffset, size_t recordLength);
+
+  private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Service {
+        std::chrono::seconds ttl{0};
+        Clock::time_point expires;
+        Clock::time_point firstSeen;
+        std::string target;
+        std::string sender;
+        std::string address;
+        // The serverinfo probe of address failed
+        bool probeFailed = false;
+    };
+
+    struct Address {
+        Clock::time_point expires;
+        std::string ipv4;
+        std::string ipv6;
+    };
+
+    void loop();
+    void resolve();
+    void expire();
+    void publish();
+
+    std::thread thread;
+    std::atomic<bool> running = false;
+    std::atomic<bool> requery = false;
+    Clock::time_point browseStart;
+
+    // Browser thread only
+    std::map<std::string, Service> services;
+    std::map<std::string, Address> addresses;
+
+    // Instance to address of probes that failed, handed from the probe
+    // workers to the browser thread
+    std::mutex failedMutex;
+    std::map<std::string, std::string> failedProbes;
+
+    // UI thread only
+    std::map<std::string, Host> found;
+    std::set<std::string> removed;
+    GSResult<std::vector<Host>> hosts =
+        GSResult<std::vector<Host>>::success({});
+    brls::Event<GSResult<std::vector<Host>>> hostsUpdateEvent;
+};
+
+#endif
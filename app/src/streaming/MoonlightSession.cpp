@@ -338,8 +338,9 @@ void MoonlightSession::stop(int terminate_app) {
 void MoonlightSession::draw(NVGcontext* vg, int width, int height) {
     if (m_video_decoder && m_video_renderer) {
         AVFrameHolder::instance().get(
-            [this, vg, width, height](AVFrame* frame) {
-                m_video_renderer->draw(vg, width, height, frame, m_video_format);
+            [this, vg, width, height](AVFrame* frame, bool fresh) {
+                m_video_renderer->draw(vg, width, height, frame, fresh,
+                                       m_video_format);
             });
 
         m_session_stats.video_decode_stats =
@@ -0,0 +1,107 @@
+//
+//  PlatformInputSource.cpp
+//  Moonlight
+//
+//  Kept apart from InputManager.cpp so the input loopback test can link
+//  the manager without the platform and the streaming view.
+//
+
+#include "InputManager.hpp"
+#include "Limelight.h"
+#include <borealis.hpp>
+#include <streaming_view.hpp>
+
+using namespace brls;
+
+class PlatformInputSource : public InputSource {
+  public:
+    int controllersConnected() override {
+        return input()->getControllersConnectedCount();
+    }
+
+    void controllerState(ControllerState* state, int controller) override {
+        input()->updateControllerState(state, controller);
+    }
+
+    void unifiedControllerState(ControllerState* state) override {
+        input()->updateUnifiedControllerState(state);
+    }
+
+    void mouseState(RawMouseState* state) override {
+        input()->updateMouseStates(state);
+    }
+
+    void rawTouchStates(std::vector<RawTouchState>* states) override {
+        input()->updateTouchStates(states);
+    }
+
+    std::vector<TouchState> streamTouches() override {
+        std::vector<TouchState> touches;
+        for (const auto& touch : Application::currentTouchState) {
+            if (touch.view && touch.view->hasParent() &&
+                dynamic_cast<StreamingView*>(touch.view->getParent()) ==
+                    nullptr)
+                break;
+            touches.push_back(touch);
+        }
+        return touches;
+    }
+
+  private:
+    static InputManager* input() {
+        return Application::getPlatform()->getInputManager();
+    }
+};
+
+MoonlightInputManager::MoonlightInputManager()
+    : MoonlightInputManager(std::make_unique<PlatformInputSource>()) {
+    auto inputManager = brls::Application::getPlatform()->getInputManager();
+
+    inputManager
+        ->getMouseCusorOffsetChanged()
+        ->subscribe([this](brls::Point offset) { addMouseMotion(offset); });
+
+    inputManager
+        ->getMouseScrollOffsetChanged()
+        ->subscribe([this](brls::Point scroll) {
+            if (!inputEnabled) return;
+
+            if (scroll.x != 0) {
+                brls::Logger::info("Mouse scroll X sended: {}", scroll.x);
+                LiSendHighResHScrollEvent( short(scroll.x));
+            }
+            if (scroll.y != 0) {
+                brls::Logger::info("Mouse scroll Y sended: {}", scroll.y);
+                LiSendHighResScrollEvent( short(scroll.y));
+            }
+        });
+
+    inputManager
+        ->getKeyboardKeyStateChanged()
+        ->subscribe([this](brls::KeyState state) {
+            if (!inputEnabled) return;
+
+            short vkKey = MoonlightInputManager::glfwKeyToVKKey(state.key);
+            char modifiers = state.mods;
+            sendKeyboardEvent(vkKey, state.pressed, modifiers);
+        });
+
+    inputManager
+        ->getControllerSensorStateChanged()
+        ->subscribe([this](brls::SensorEvent event) {
+            if (!inputEnabled) return;
+            
+            switch (event.type) {
+                case brls::SensorEventType::ACCEL:
+                    handleMotion(event.controllerIndex, LI_MOTION_TYPE_ACCEL, event.data[0], event.data[1], event.data[2]);
+                    break;
+                case brls::SensorEventType::GYRO:
+                    // Convert rad/s to deg/s
+                    handleMotion(event.controllerIndex, LI_MOTION_TYPE_GYRO,
+                        event.data[0] * 57.2957795f,
+                        event.data[1] * 57.2957795f,
+                        event.data[2] * 57.2957795f);
+                    break;
+            }
+        });
+}
@@ -3,15 +3,30 @@
 #include "Settings.hpp"
 #include <borealis.hpp>
 #include <cerrno>
+#include <chrono>
 #include <cstring>
+#include <thread>
+#include <vector>
 
 #if defined(__linux) || defined(__APPLE__) || defined(__SWITCH__) || defined(__vita__)
 #define UNIX_SOCKS
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <sys/select.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#if !defined(__SWITCH__) && !defined(__vita__)
+#include <ifaddrs.h>
+#include <net/if.h>
+#endif
+
+typedef int wol_socket_t;
+#define WOL_INVALID_SOCKET -1
+#define wol_close close
 
 #elif defined(_WIN32)
 #define WIN32_SOCKS
@@ -20,6 +35,10 @@
 #include <winsock2.h>
 #include <ws2tcpip.h>
 
+typedef SOCKET wol_socket_t;
+#define WOL_INVALID_SOCKET INVALID_SOCKET
+#define wol_close closesocket
+
 #endif
 
 #if defined(__SWITCH__)
@@ -41,134 +60,162 @@ static Data mac_string_to_bytes(std::string mac) {
 }
 
 static Data create_payload(const Host& host) {
-    Data payload;
+    DataBuilder payload(102);
 
     // 6 bytes of FF
-    uint8_t header = 0xFF;
-    for (int i = 0; i < 6; i++) {
-        payload = payload.append(Data(&header, 1));
-    }
+    uint8_t header[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    payload.append(header, sizeof(header));
 
     // 16 repitiions of MAC address
     Data mac_address = mac_string_to_bytes(host.mac);
     for (int i = 0; i < 16; i++) {
-        payload = payload.append(mac_address);
+        payload.append(mac_address);
     }
-    return payload;
+    return payload.build();
 }
 #endif
 
-#if defined(UNIX_SOCKS)
-GSResult<bool> send_packet_unix(const Host& host, const Data& payload) {
-    struct sockaddr_in udpClient{}, udpServer{};
-    int broadcast = 1;
+#if defined(UNIX_SOCKS) || defined(WIN32_SOCKS)
+// Each burst is repeated a few times since a single datagram to a sleeping
+// NIC is easily lost
+static const int wake_up_bursts = 3;
+static const std::chrono::milliseconds wake_up_burst_interval(50);
+static const unsigned short wake_up_ports[] = {7, 9};
 
-    int udpSocket = socket(AF_INET, SOCK_DGRAM, 0);
-    if (udpSocket == -1) {
-        brls::Logger::error(
-            "WakeOnLanManager: An error was encountered creating "
-            "the UDP socket: '{}'",
-            strerror(errno));
-        return GSResult<bool>::failure(
-            "An error was encountered creating the UDP socket: " +
-            std::string(strerror(errno)));
-    }
+static std::string socket_error() {
+#if defined(WIN32_SOCKS)
+    return std::to_string(WSAGetLastError());
+#else
+    return strerror(errno);
+#endif
+}
 
-    int setsock_result = setsockopt(udpSocket, SOL_SOCKET, SO_BROADCAST,
-                                    &broadcast, sizeof broadcast);
-    if (setsock_result == -1) {
-        brls::Logger::error(
-            "WakeOnLanManager: Failed to set socket options: '{}'",
-            strerror(errno));
-        return GSResult<bool>::failure("Failed to set socket options: " +
-                                       std::string(strerror(errno)));
+// Splits "ip[:port]" and parses the IPv4 part, in network byte order
+static bool parse_host_address(const Host& host, uint32_t* address,
+                               unsigned short* port) {
+    std::string ip = host.address.substr(0, host.address.find(':'));
+    if (port) {
+        size_t colon = host.address.find(':');
+        *port = colon == std::string::npos
+                    ? 47989
+                    : (unsigned short)atoi(host.address.c_str() + colon + 1);
     }
 
-    // Set parameters
-    udpClient.sin_family = AF_INET;
-    udpClient.sin_addr.s_addr = INADDR_ANY;
-    udpClient.sin_port = 0;
-    // Bind socket
-    int bind_result =
-        bind(udpSocket, (struct sockaddr*)&udpClient, sizeof(udpClient));
-    if (bind_result == -1) {
-        brls::Logger::error("WakeOnLanManager: Failed to bind socket: '{}'",
-                            strerror(errno));
-        return GSResult<bool>::failure("Failed to bind socket: " +
-                                       std::string(strerror(errno)));
-    }
+    struct in_addr addr;
+    if (inet_pton(AF_INET, ip.c_str(), &addr) != 1)
+        return false;
+
+    *address = addr.s_addr;
+    return true;
+}
+
+// Network byte order: the subnet broadcast of every interface, the limited
+// broadcast and the last known address of the host
+static std::vector<uint32_t> wake_up_destinations(const Host& host) {
+    std::vector<uint32_t> destinations;
 
-    // Set server end point (the broadcast addres)
-    udpServer.sin_family = AF_INET;
 #if defined(__SWITCH__)
     uint32_t ip, subnet_mask;
     // Get the current IP address and subnet mask to calculate subnet broadcast address
-    nifmGetCurrentIpConfigInfo(&ip, &subnet_mask, nullptr, nullptr, nullptr);
-    udpServer.sin_addr.s_addr = ip | ~subnet_mask;
-#else
-    udpServer.sin_addr.s_addr = inet_addr(host.address.c_str());
+    if (R_SUCCEEDED(nifmGetCurrentIpConfigInfo(&ip, &subnet_mask, nullptr,
+                                               nullptr, nullptr)))
+        destinations.push_back(ip | ~subnet_mask);
+#elif defined(UNIX_SOCKS) && !defined(__vita__)
+    struct ifaddrs* interfaces = nullptr;
+    if (getifaddrs(&interfaces) == 0) {
+        for (struct ifaddrs* ifa = interfaces; ifa; ifa = ifa->ifa_next) {
+            if (!ifa->ifa_addr || !ifa->ifa_netmask ||
+                ifa->ifa_addr->sa_family != AF_INET ||
+                !(ifa->ifa_flags & IFF_UP) || (ifa->ifa_flags & IFF_LOOPBACK))
+                continue;
+
+            uint32_t ip = ((struct sockaddr_in*)ifa->ifa_addr)->sin_addr.s_addr;
+            uint32_t mask =
+                ((struct sockaddr_in*)ifa->ifa_netmask)->sin_addr.s_addr;
+            destinations.push_back(ip | ~mask);
+        }
+        freeifaddrs(interfaces);
+    }
 #endif
-    udpServer.sin_port = htons(9);
 
-    brls::Logger::info("WakeOnLanManager: Sending magic packet to: '{}'",
-                    inet_ntoa(udpServer.sin_addr));
+    destinations.push_back(INADDR_BROADCAST);
 
-    // Send the packet
-    ssize_t result =
-        sendto(udpSocket, payload.bytes(), sizeof(unsigned char) * 102, 0,
-               (struct sockaddr*)&udpServer, sizeof(udpServer));
-    if (result == -1) {
-        brls::Logger::error(
-            "WakeOnLanManager: Failed to send magic packet to socket: '{}'",
-            strerror(errno));
-        return GSResult<bool>::failure(
-            "Failed to send magic packet to socket: " +
-            std::string(strerror(errno)));
-    }
-    return GSResult<bool>::success(true);
+    uint32_t unicast;
+    if (parse_host_address(host, &unicast, nullptr))
+        destinations.push_back(unicast);
+
+    return destinations;
 }
-#elif defined(_WIN32)
-GSResult<bool> send_packet_win32(const Host& host, const Data& payload) {
-    struct sockaddr_in udpClient, udpServer;
-    int broadcast = 1;
 
+static GSResult<bool> send_packets(const Host& host, const Data& payload) {
+#if defined(WIN32_SOCKS)
     WSADATA data;
-    SOCKET udpSocket;
-
-    // Setup broadcast socket
     WSAStartup(MAKEWORD(2, 2), &data);
-    udpSocket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+#endif
+
+    wol_socket_t udpSocket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (udpSocket == WOL_INVALID_SOCKET) {
+        brls::Logger::error(
+            "WakeOnLanManager: An error was encountered creating "
+            "the UDP socket: '{}'",
+            socket_error());
+        return GSResult<bool>::failure(
+            "An error was encountered creating the UDP socket: " +
+            socket_error());
+    }
 
+    int broadcast = 1;
     if (setsockopt(udpSocket, SOL_SOCKET, SO_BROADCAST, (char*)&broadcast,
                    sizeof(broadcast)) == -1) {
-        return GSResult<bool>::failure("Failed to setup a broadcast socket");
+        brls::Logger::error(
+            "WakeOnLanManager: Failed to set socket options: '{}'",
+            socket_error());
+        std::string error = "Failed to set socket options: " + socket_error();
+        wol_close(udpSocket);
+        return GSResult<bool>::failure(error);
     }
 
-    // Set parameters
-    udpClient.sin_family = AF_INET;
-    udpClient.sin_addr.s_addr = INADDR_ANY;
-    udpClient.sin_port = htons(0);
-    // Bind socket
-    bind(udpSocket, (struct sockaddr*)&udpClient, sizeof(udpClient));
+    std::vector<uint32_t> destinations = wake_up_destinations(host);
+    int sent = 0;
+    std::string lastError;
 
-    // Set server end point (the broadcast addres)
-    udpServer.sin_family = AF_INET;
-#if defined(__SWITCH__)
-    uint32_t ip, subnet_mask;
-    // Get the current IP address and subnet mask to calculate subnet broadcast address
-    nifmGetCurrentIpConfigInfo(&ip, &subnet_mask, nullptr, nullptr, nullptr);
-    udpServer.sin_addr.s_addr = ip | ~subnet_mask;
-#else
-    udpServer.sin_addr.s_addr = inet_addr(host.address.c_str());
-#endif
-    udpServer.sin_port = htons(9);
+    for (int burst = 0; burst < wake_up_bursts; burst++) {
+        if (burst > 0)
+            std::this_thread::sleep_for(wake_up_burst_interval);
+
+        for (uint32_t destination : destinations) {
+            for (unsigned short port : wake_up_ports) {
+                struct sockaddr_in udpServer{};
+                udpServer.sin_family = AF_INET;
+                udpServer.sin_addr.s_addr = destination;
+                udpServer.sin_port = htons(port);
+
+                if (burst == 0)
+                    brls::Logger::info(
+                        "WakeOnLanManager: Sending magic packet to: '{}:{}'",
+                        inet_ntoa(udpServer.sin_addr), port);
+
+                if (sendto(udpSocket, (const char*)payload.bytes(),
+                           (int)payload.size(), 0,
+                           (struct sockaddr*)&udpServer,
+                           sizeof(udpServer)) == -1) {
+                    lastError = socket_error();
+                } else {
+                    sent++;
+                }
+            }
+        }
+    }
 
-    brls::Logger::info("WakeOnLanManager: Sending magic packet to: '{}'",
-                    inet_ntoa(udpServer.sin_addr));
+    wol_close(udpSocket);
 
-    // Send the packet
-    sendto(udpSocket, (const char*)payload.bytes(), sizeof(unsigned char) * 102,
-           0, (struct sockaddr*)&udpServer, sizeof(udpServer));
+    if (sent == 0) {
+        brls::Logger::error(
+            "WakeOnLanManager: Failed to send magic packet to socket: '{}'",
+            lastError);
+        return GSResult<bool>::failure(
+            "Failed to send magic packet to socket: " + lastError);
+    }
     return GSResult<bool>::success(true);
 }
 #endif
@@ -182,13 +229,58 @@ bool WakeOnLanManager::can_wake_up_host(const Host& host) {
 }
 
 GSResult<bool> WakeOnLanManager::wake_up_host(const Host& host) {
-    Data payload = create_payload(host);
-
-#if defined(UNIX_SOCKS)
-    return send_packet_unix(host, payload);
-#elif defined(_WIN32)
-    return send_packet_win32(host, payload);
+#if defined(UNIX_SOCKS) || defined(WIN32_SOCKS)
+    return send_packets(host, create_payload(host));
 #endif
 
     return GSResult<bool>::failure("Wake up host not supported...");
 }
+
+bool WakeOnLanManager::is_host_listening(const Host& host, int timeout_ms) {
+#if defined(UNIX_SOCKS) || defined(WIN32_SOCKS)
+    uint32_t address;
+    unsigned short port;
+    if (!parse_host_address(host, &address, &port))
+        return false;
+
+    struct sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = address;
+    addr.sin_port = htons(port);
+
+    wol_socket_t sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (sock == WOL_INVALID_SOCKET)
+        return false;
+
+#if defined(WIN32_SOCKS)
+    u_long nonblocking = 1;
+    ioctlsocket(sock, FIONBIO, &nonblocking);
+#else
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+#endif
+
+    bool listening = connect(sock, (struct sockaddr*)&addr, sizeof(addr)) == 0;
+    if (!listening) {
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(sock, &fds);
+
+        struct timeval timeout;
+        timeout.tv_sec = timeout_ms / 1000;
+        timeout.tv_usec = (timeout_ms % 1000) * 1000;
+
+        if (select((int)sock + 1, nullptr, &fds, nullptr, &timeout) > 0) {
+            int error = 0;
+            socklen_t length = sizeof(error);
+            listening = getsockopt(sock, SOL_SOCKET, SO_ERROR, (char*)&error,
+                                   &length) == 0 &&
+                        error == 0;
+        }
+    }
+
+    wol_close(sock);
+    return listening;
+#else
+    return false;
+#endif
+}
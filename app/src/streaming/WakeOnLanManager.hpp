@@ -8,6 +8,8 @@ class WakeOnLanManager : public Singleton<WakeOnLanManager> {
   private:
     static bool can_wake_up_host(const Host& host);
     static GSResult<bool> wake_up_host(const Host& host);
+    // True once the host accepts connections on its GameStream port
+    static bool is_host_listening(const Host& host, int timeout_ms);
 
     friend class GameStreamClient;
 };
@@ -143,8 +143,9 @@ void AudrenAudioRenderer::decode_and_play_sample(char* data, int length) {
                 m_decoder, (const unsigned char*)data, length, m_decoded_buffer,
                 m_samples_per_frame, 0);
 
+            double volume = Settings::instance().snapshot()->volume / 100.0;
             for (int i = 0; i < m_samples_per_frame * m_channel_count; i++) {
-                int scale = (int)((double)m_decoded_buffer[i] * (Settings::instance().get_volume() / 100.0));
+                int scale = (int)((double)m_decoded_buffer[i] * volume);
                 m_decoded_buffer[i] = (s16) std::min(SHRT_MAX, std::max(SHRT_MIN, scale));
             }
 
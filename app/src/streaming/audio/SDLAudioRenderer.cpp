@@ -88,8 +88,9 @@ void SDLAudioRenderer::decode_and_play_sample(char* sample_data,
         return;
     }
 
+    double volume = Settings::instance().snapshot()->volume / 100.0;
     for (short & i : pcmBuffer) {
-        int scale = (int)((double)i * (Settings::instance().get_volume() / 100.0));
+        int scale = (int)((double)i * volume);
         i = (short) std::min(SHRT_MAX, std::max(SHRT_MIN, scale));
     }
 
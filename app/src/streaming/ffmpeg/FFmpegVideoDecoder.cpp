@@ -117,7 +117,7 @@ int FFmpegVideoDecoder::setup(int video_format, int width, int height,
 
     m_decoder_context->flags2 |= AV_CODEC_FLAG2_FAST;
 
-    int decoder_threads = Settings::instance().decoder_threads();
+    int decoder_threads = Settings::instance().snapshot()->decoder_threads;
 
     if (decoder_threads == 0) {
         m_decoder_context->thread_type = FF_THREAD_FRAME;
@@ -149,7 +149,7 @@ int FFmpegVideoDecoder::setup(int video_format, int width, int height,
     AVFrameHolder::instance().prepare();
 
     // One extra frame for decoding processing
-    m_frames_size = Settings::instance().frames_queue_size() + 1;
+    m_frames_size = Settings::instance().snapshot()->frames_queue_size + 1;
     m_frames = new AVFrame*[m_frames_size];
 
     tmp_frame = av_frame_alloc();
@@ -210,7 +210,7 @@ int FFmpegVideoDecoder::setup(int video_format, int width, int height,
         AVHWDeviceType hwType = AV_HWDEVICE_TYPE_NONE;
 #endif
 
-    if (Settings::instance().use_hw_decoding() && hwType != AV_HWDEVICE_TYPE_NONE) {
+    if (Settings::instance().snapshot()->use_hw_decoding && hwType != AV_HWDEVICE_TYPE_NONE) {
         if ((err = av_hwdevice_ctx_create(&hw_device_ctx, hwType, nullptr, nullptr, 0)) < 0) {
             char error[512];
             av_strerror(err, error, sizeof(error));
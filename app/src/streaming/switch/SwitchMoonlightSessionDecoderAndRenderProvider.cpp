@@ -36,7 +36,7 @@ SwitchMoonlightSessionDecoderAndRenderProvider::video_renderer() {
 IAudioRenderer*
 SwitchMoonlightSessionDecoderAndRenderProvider::audio_renderer() {
 #ifdef __SWITCH__
-    if (Settings::instance().audio_backend() == SDL) {
+    if (Settings::instance().snapshot()->audio_backend == SDL) {
         return new SDLAudioRenderer();
     } else {
         return new AudrenAudioRenderer();
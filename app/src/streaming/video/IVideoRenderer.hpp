@@ -22,8 +22,10 @@ struct VideoRenderStats {
 class IVideoRenderer {
   public:
     virtual ~IVideoRenderer(){};
+    // fresh is false when frame was already drawn and only the screen needs
+    // to be repainted
     virtual void draw(NVGcontext* vg, int width, int height,
-                      AVFrame* frame, int imageFormat) = 0;
+                      AVFrame* frame, bool fresh, int imageFormat) = 0;
     virtual VideoRenderStats* video_render_stats() = 0;
 
     // Default implementations
@@ -234,7 +234,7 @@ void GLVideoRenderer::checkAndInitialize(int width, int height,
     }
 }
 
-void GLVideoRenderer::checkAndUpdateScale(int width, int height,
+bool GLVideoRenderer::checkAndUpdateScale(int width, int height,
                                           AVFrame* frame) {
     if ((m_frame_width != frame->width) || (m_frame_height != frame->height) ||
         (m_screen_width != width) || (m_screen_height != height) ||
@@ -286,11 +286,13 @@ void GLVideoRenderer::checkAndUpdateScale(int width, int height,
             glUniform4f(m_uv_data_location, 0.0f,
                         0.5f - 0.5f * (1.0f / multiplier), 1.0f, multiplier);
         }
+        return true;
     }
+    return false;
 }
 
 void GLVideoRenderer::draw(NVGcontext* vg, int width, int height,
-                           AVFrame* frame, int imageFormat) {
+                           AVFrame* frame, bool fresh, int imageFormat) {
     if (!m_video_render_stats_progress.rendered_frames) {
         m_video_render_stats_progress.measurement_start_timestamp = LiGetMillis();
     }
@@ -302,7 +304,8 @@ void GLVideoRenderer::draw(NVGcontext* vg, int width, int height,
     glBindVertexArray(m_vao);
 
     glUseProgram(m_shader_program);
-    checkAndUpdateScale(width, height, frame);
+    // Recreated textures must be filled even for a repeated frame
+    fresh |= checkAndUpdateScale(width, height, frame);
 
     glClearColor(1, 1, 0, 1);
     glClear(GL_COLOR_BUFFER_BIT);
@@ -312,9 +315,12 @@ void GLVideoRenderer::draw(NVGcontext* vg, int width, int height,
         glActiveTexture(GL_TEXTURE0 + i);
 		int real_width = frame->linesize[i] / currentPlanes[i][0];
         glBindTexture(GL_TEXTURE_2D, m_texture_id[i]);
-        glPixelStorei(GL_UNPACK_ROW_LENGTH, real_width);
-        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, textureWidth[i],
-                        textureHeight[i], currentPlanes[i][4], currentFormat, image);
+        // NanoVG rebinds unit 0 between frames, so only the upload is skipped
+        if (fresh) {
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, real_width);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, textureWidth[i],
+                            textureHeight[i], currentPlanes[i][4], currentFormat, image);
+        }
         glActiveTexture(GL_TEXTURE0);
     }
 
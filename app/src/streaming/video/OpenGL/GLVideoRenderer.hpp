@@ -24,7 +24,7 @@ class GLVideoRenderer : public IVideoRenderer {
     GLVideoRenderer(){};
     ~GLVideoRenderer();
 
-    void draw(NVGcontext* vg, int width, int height, AVFrame* frame, int imageFormat) override;
+    void draw(NVGcontext* vg, int width, int height, AVFrame* frame, bool fresh, int imageFormat) override;
 
     VideoRenderStats* video_render_stats() override;
 
@@ -32,7 +32,7 @@ class GLVideoRenderer : public IVideoRenderer {
     void bindTexture(int id);
     void initialize(AVFrame* frame);
     void checkAndInitialize(int width, int height, AVFrame* frame);
-    void checkAndUpdateScale(int width, int height, AVFrame* frame);
+    bool checkAndUpdateScale(int width, int height, AVFrame* frame);
 
     bool m_is_initialized = false;
     GLuint m_texture_id[PLANES_NUM_MAX] = {0, 0, 0};
@@ -230,7 +230,7 @@ void DKVideoRenderer::checkAndInitialize(int width, int height, AVFrame* frame)
 int frames = 0;
 uint64_t timeCount = 0;
 
-void DKVideoRenderer::draw(NVGcontext* vg, int width, int height, AVFrame* frame, int imageFormat) {
+void DKVideoRenderer::draw(NVGcontext* vg, int width, int height, AVFrame* frame, bool fresh, int imageFormat) {
     checkAndInitialize(width, height, frame);
 
     uint64_t before_render = LiGetMillis();
@@ -18,7 +18,7 @@ class DKVideoRenderer : public IVideoRenderer {
     DKVideoRenderer();
     ~DKVideoRenderer();
 
-    void draw(NVGcontext* vg, int width, int height, AVFrame* frame, int imageFormat) override;
+    void draw(NVGcontext* vg, int width, int height, AVFrame* frame, bool fresh, int imageFormat) override;
 
     VideoRenderStats* video_render_stats() override;
 
@@ -6,6 +6,7 @@
 //
 
 #include "streaming_input_overlay.hpp"
+#include "InputManager.hpp"
 #include <Limelight.h>
 
 using namespace brls;
@@ -58,14 +59,16 @@ void StreamingInputOverlay::draw(NVGcontext* vg, float x, float y, float width,
         static KeyboardState oldKeyboardState;
         KeyboardState keyboardState = keyboard->getKeyboardState();
 
-        for (int i = 0; i < _VK_KEY_MAX; i++) {
-            if (keyboardState.keys[i] != oldKeyboardState.keys[i]) {
-                oldKeyboardState.keys[i] = keyboardState.keys[i];
-                LiSendKeyboardEvent(
+        auto changed = keyboardState.keys ^ oldKeyboardState.keys;
+        for (int i = 0; changed.any() && i < _VK_KEY_MAX; i++) {
+            if (changed[i]) {
+                changed[i] = false;
+                MoonlightInputManager::instance().sendKeyboardEvent(
                     keyboard->getKeyCode((KeyboardKeys)i),
-                    keyboardState.keys[i] ? KEY_ACTION_DOWN : KEY_ACTION_UP, 0);
+                    keyboardState.keys[i], 0);
             }
         }
+        oldKeyboardState = keyboardState;
     }
 
     if (!isKeyboardOpen) {
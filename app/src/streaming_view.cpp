@@ -27,6 +27,9 @@
 
 using namespace brls;
 
+// How often the stats overlay text is rebuilt
+static const std::chrono::milliseconds stats_interval(250);
+
 #ifdef PLATFORM_TVOS
 extern void updatePreferredDisplayMode(bool streamActive);
 #endif
@@ -102,9 +105,11 @@ StreamingView::StreamingView(const Host& host, const AppInfo& app) : host(host),
                     showError(result.error(), [this]() { terminate(false); });
                 }
             });
-        });
+        },
+        false);
 
     MoonlightInputManager::instance().reloadButtonMappingLayout();
+    MoonlightInputManager::instance().startPolling();
 
     static bool lMouseKeyGate = false;
     static bool lMouseKeyUsed = false;
@@ -286,6 +291,11 @@ void StreamingView::draw(NVGcontext* vg, float x, float y, float width,
         return;
     }
 
+    // Follow the decoder instead of vsync unless the keyboard or an overlay
+    // is animating on top of the stream
+    AVFrameHolder::instance().setPaced(focused && !keyboard &&
+                                       session->is_active());
+
     session->draw(vg, (int) width, (int) height);
 
     if (!tempInputLock && session->is_active())
@@ -316,10 +326,13 @@ void StreamingView::draw(NVGcontext* vg, float x, float y, float width,
 #endif
     }
 
-    if (draw_stats) {
+    // The numbers only move a few times per second
+    auto now = std::chrono::steady_clock::now();
+    if (draw_stats && now - statsUpdated >= stats_interval) {
+        statsUpdated = now;
         auto stats = session->session_stats();
 
-        auto statistics = fmt::format(
+        statistics = fmt::format(
                     "Estimated host PC frame rate: {:.{}f} FPS\n"
                         "Incoming frame rate from network: {:.{}f} FPS\n"
                         "Decoding frame rate: {:.{}f} FPS\n"
@@ -347,6 +360,29 @@ void StreamingView::draw(NVGcontext* vg, float x, float y, float width,
                                   AVFrameHolder::instance().getFrameDropStat(),
                                   AVFrameHolder::instance().getFrameQueueSize());
 
+        static const char* inputKinds[_INPUT_KIND_MAX] = {
+            "Gamepad", "Keyboard", "Mouse buttons", "Mouse motion", "Touch", "Motion"};
+        InputPollStats input = MoonlightInputManager::instance().pollStats();
+        statistics += fmt::format("\nInput polling: {}\n"
+                                  "Input CPU time per frame: {:.{}f} | {:.{}f} ms\n"
+                                  "Input to send p50 | p99 | max:",
+                                  input.rate ? fmt::format("{} Hz", input.rate)
+                                             : "per frame",
+                                  input.average_frame_us / 1000, 3,
+                                  input.max_frame_us / 1000, 3);
+        for (int i = 0; i < _INPUT_KIND_MAX; i++) {
+            const LatencyHistogram& histogram = input.latency[i];
+            if (histogram.total == 0)
+                continue;
+            statistics += fmt::format("\n  {}: {:.{}f} | {:.{}f} | {:.{}f} ms",
+                                      inputKinds[i],
+                                      histogram.percentile(0.5) / 1000, 3,
+                                      histogram.percentile(0.99) / 1000, 3,
+                                      histogram.max_us / 1000, 3);
+        }
+    }
+
+    if (draw_stats) {
         nvgFontFaceId(vg, Application::getFont(FONT_REGULAR));
         nvgFontSize(vg, 20);
         nvgTextAlign(vg, NVG_ALIGN_LEFT | NVG_ALIGN_BOTTOM);
@@ -385,6 +421,8 @@ void StreamingView::terminate(bool terminateApp) {
         return;
     terminated = true;
 
+    MoonlightInputManager::instance().stopPolling();
+    AVFrameHolder::instance().setPaced(false);
     session->stop(terminateApp);
 
     int controllersCount = Application::getPlatform()->getInputManager()->getControllersConnectedCount();
@@ -409,14 +447,16 @@ void StreamingView::handleInput() {
         static KeyboardState oldKeyboardState;
         KeyboardState keyboardState = keyboard->getKeyboardState();
 
-        for (int i = 0; i < _VK_KEY_MAX; i++) {
-            if (keyboardState.keys[i] != oldKeyboardState.keys[i]) {
-                oldKeyboardState.keys[i] = keyboardState.keys[i];
-                LiSendKeyboardEvent(
+        auto changed = keyboardState.keys ^ oldKeyboardState.keys;
+        for (int i = 0; changed.any() && i < _VK_KEY_MAX; i++) {
+            if (changed[i]) {
+                changed[i] = false;
+                MoonlightInputManager::instance().sendKeyboardEvent(
                     keyboard->getKeyCode((KeyboardKeys)i),
-                    keyboardState.keys[i] ? KEY_ACTION_DOWN : KEY_ACTION_UP, 0);
+                    keyboardState.keys[i], 0);
             }
         }
+        oldKeyboardState = keyboardState;
 
         // Drop input if keyboard overlay presented
 //        MoonlightInputManager::instance().dropInput();
@@ -553,6 +593,8 @@ StreamingView::~StreamingView() {
         ->getInputManager()
         ->getKeyboardKeyStateChanged()
         ->unsubscribe(keysSubscription);
+    MoonlightInputManager::instance().stopPolling();
+    AVFrameHolder::instance().setPaced(false);
     session->stop(false);
     delete session;
 }
@@ -0,0 +1,137 @@
+#include "AppListCache.hpp"
+#include "Data.hpp"
+#include "Settings.hpp"
+#include <algorithm>
+#include <borealis.hpp>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+
+// File layout: magic, version, app count, then per app its id, the name
+// length and the name bytes. All integers are 32 bit, native endian.
+static const uint32_t app_list_magic = 0x4D4C414C; // "MLAL"
+static const uint32_t app_list_version = 1;
+
+AppInfoList AppListCache::load(const std::string& uniqueid) {
+    if (uniqueid.empty())
+        return {};
+
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    if (m_apps.count(uniqueid))
+        return m_apps[uniqueid];
+
+    AppInfoList apps;
+    Data data = Data::read_from_file(path(uniqueid));
+    if (!data.is_empty() && !decode(data, &apps)) {
+        brls::Logger::error("AppListCache: Ignoring corrupted cache of {}",
+                            uniqueid);
+        apps.clear();
+    }
+
+    m_apps[uniqueid] = apps;
+    return apps;
+}
+
+void AppListCache::store(const std::string& uniqueid, const AppInfoList& apps) {
+    if (uniqueid.empty())
+        return;
+
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+
+        auto it = m_apps.find(uniqueid);
+        if (it != m_apps.end() &&
+            std::equal(it->second.begin(), it->second.end(), apps.begin(),
+                       apps.end(), [](const AppInfo& l, const AppInfo& r) {
+                           return l.app_id == r.app_id && l.name == r.name;
+                       })) {
+            return;
+        }
+
+        m_apps[uniqueid] = apps;
+    }
+
+    Data data = encode(apps);
+    std::string file = path(uniqueid);
+
+    brls::async([this, data, file] {
+        std::lock_guard<std::mutex> guard(m_mutex);
+
+        // Write aside and swap so a crash never leaves a truncated list
+        std::string tmp = file + ".tmp";
+        data.write_to_file(tmp);
+        if (rename(tmp.c_str(), file.c_str()) != 0) {
+            remove(file.c_str());
+            rename(tmp.c_str(), file.c_str());
+        }
+    });
+}
+
+std::string AppListCache::path(const std::string& uniqueid) {
+    std::string name;
+    for (char c : uniqueid) {
+        if (isalnum((unsigned char)c) || c == '-')
+            name += c;
+    }
+    return Settings::instance().app_list_dir() + "/" + name + ".bin";
+}
+
+Data AppListCache::encode(const AppInfoList& apps) {
+    size_t size = sizeof(uint32_t) * 3;
+    for (const AppInfo& app : apps)
+        size += sizeof(int32_t) + sizeof(uint32_t) + app.name.size();
+
+    DataBuilder builder(size);
+    uint32_t count = (uint32_t)apps.size();
+    builder.append(&app_list_magic, sizeof(app_list_magic));
+    builder.append(&app_list_version, sizeof(app_list_version));
+    builder.append(&count, sizeof(count));
+
+    for (const AppInfo& app : apps) {
+        int32_t app_id = app.app_id;
+        uint32_t length = (uint32_t)app.name.size();
+        builder.append(&app_id, sizeof(app_id));
+        builder.append(&length, sizeof(length));
+        builder.append(app.name.data(), length);
+    }
+    return builder.build();
+}
+
+bool AppListCache::decode(const Data& data, AppInfoList* apps) {
+    const unsigned char* bytes = data.bytes();
+    size_t size = data.size();
+    size_t offset = 0;
+
+    auto read_u32 = [&](uint32_t* value) {
+        if (offset + sizeof(uint32_t) > size)
+            return false;
+        memcpy(value, bytes + offset, sizeof(uint32_t));
+        offset += sizeof(uint32_t);
+        return true;
+    };
+
+    uint32_t magic, version, count;
+    if (!read_u32(&magic) || !read_u32(&version) || !read_u32(&count))
+        return false;
+
+    if (magic != app_list_magic || version != app_list_version)
+        return false;
+
+    // Every entry takes at least 8 bytes, so bigger counts are garbage
+    if (count > (size - offset) / 8)
+        return false;
+
+    apps->reserve(count);
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t app_id, length;
+        if (!read_u32(&app_id) || !read_u32(&length) ||
+            offset + length > size)
+            return false;
+
+        apps->push_back({std::string((const char*)bytes + offset, length),
+                         (int)app_id});
+        offset += length;
+    }
+    return true;
+}
@@ -0,0 +1,24 @@
+#include "GameStreamClient.hpp"
+#include "Singleton.hpp"
+#include <map>
+#include <mutex>
+#include <string>
+#pragma once
+
+class Data;
+
+// Last known app list of every host, keyed by the host uniqueid and kept on
+// disk so the app list can be drawn before the host answers.
+class AppListCache : public Singleton<AppListCache> {
+  public:
+    AppInfoList load(const std::string& uniqueid);
+    void store(const std::string& uniqueid, const AppInfoList& apps);
+
+  private:
+    static std::string path(const std::string& uniqueid);
+    static Data encode(const AppInfoList& apps);
+    static bool decode(const Data& data, AppInfoList* apps);
+
+    std::mutex m_mutex;
+    std::map<std::string, AppInfoList> m_apps;
+};
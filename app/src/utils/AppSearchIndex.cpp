@@ -0,0 +1,190 @@
+#include "AppSearchIndex.hpp"
+#include <algorithm>
+#include <cctype>
+
+// Base letters of U+00C0 to U+017F, a space for symbols
+static const char latin_folds[] = "aaaaaaaceeeeiiiidnooooo ouuuuyts"
+                                  "aaaaaaaceeeeiiiidnooooo ouuuuyty"
+                                  "aaaaaaccccccccddddeeeeeeeeeegggg"
+                                  "gggghhhhiiiiiiiiiiiijjkkklllllll"
+                                  "lllnnnnnnnnnoooooooorrrrrrssssss"
+                                  "ssttttttuuuuuuuuuuuuwwyyyzzzzzzs";
+
+static uint32_t trigram(const std::string& text, size_t offset) {
+    return (uint32_t)(unsigned char)text[offset] << 16 |
+           (uint32_t)(unsigned char)text[offset + 1] << 8 |
+           (uint32_t)(unsigned char)text[offset + 2];
+}
+
+std::string AppSearchIndex::fold(const std::string& text) {
+    std::string result;
+    result.reserve(text.size());
+
+    bool space = true;
+    auto put = [&](char c) {
+        if (c != ' ') {
+            result += c;
+            space = false;
+        } else if (!space) {
+            result += ' ';
+            space = true;
+        }
+    };
+
+    for (size_t i = 0; i < text.size();) {
+        unsigned char c = text[i];
+        if (c < 0x80) {
+            put(std::isalnum(c) ? (char)std::tolower(c) : ' ');
+            i++;
+            continue;
+        }
+
+        size_t length = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 1;
+        if (i + length > text.size())
+            break;
+
+        uint32_t codepoint =
+            length == 2 ? (c & 0x1F) << 6 | (text[i + 1] & 0x3F) : 0;
+        if (codepoint >= 0xC0 && codepoint < 0x180) {
+            put(latin_folds[codepoint - 0xC0]);
+        } else if (codepoint >= 0x80 && codepoint < 0xC0) {
+            // Latin-1 punctuation and marks like (R)
+            put(' ');
+        } else {
+            // Other scripts are matched as they are
+            result.append(text, i, length);
+            space = false;
+        }
+        i += length;
+    }
+
+    if (!result.empty() && result.back() == ' ')
+        result.pop_back();
+    return result;
+}
+
+AppSearchIndex::AppSearchIndex(const AppInfoList& apps) {
+    m_names.reserve(apps.size());
+
+    for (uint32_t i = 0; i < apps.size(); i++) {
+        std::string name = fold(apps[i].name);
+
+        size_t start = 0;
+        while (start < name.size()) {
+            size_t end = std::min(name.find(' ', start), name.size());
+            m_words.push_back({name.substr(start, end - start), i, start == 0});
+            start = end + 1;
+        }
+
+        for (size_t j = 0; j + 3 <= name.size(); j++) {
+            std::vector<uint32_t>& postings = m_trigrams[trigram(name, j)];
+            if (postings.empty() || postings.back() != i)
+                postings.push_back(i);
+        }
+
+        m_names.push_back(std::move(name));
+    }
+
+    std::sort(m_words.begin(), m_words.end());
+    m_hits.assign(apps.size(), 0);
+}
+
+const std::vector<size_t>& AppSearchIndex::search(const std::string& query) {
+    std::string folded = fold(query);
+    if (folded == m_last_query)
+        return m_result;
+
+    m_last_query = folded;
+    m_result.clear();
+
+    if (folded.empty()) {
+        for (size_t i = 0; i < m_names.size(); i++)
+            m_result.push_back(i);
+        return m_result;
+    }
+
+    m_ranked.clear();
+    if (folded.size() < 3)
+        match_prefix(folded);
+    else
+        match_trigrams(folded);
+
+    // Lower rank first, list order within a rank
+    std::sort(m_ranked.begin(), m_ranked.end());
+    for (const auto& [rank, app] : m_ranked)
+        m_result.push_back(app);
+    return m_result;
+}
+
+void AppSearchIndex::match_prefix(const std::string& query) {
+    // Too short for trigrams, match the start of words instead
+    auto it = std::lower_bound(m_words.begin(), m_words.end(),
+                               Word{query, 0, false});
+    for (; it != m_words.end() && it->text.compare(0, query.size(), query) == 0;
+         it++) {
+        uint16_t rank = it->first ? 1 : 2;
+        if (m_hits[it->app] == 0)
+            m_touched.push_back(it->app);
+        if (m_hits[it->app] == 0 || rank < m_hits[it->app])
+            m_hits[it->app] = rank;
+    }
+
+    for (uint32_t app : m_touched) {
+        m_ranked.push_back({m_hits[app] - 1, app});
+        m_hits[app] = 0;
+    }
+    m_touched.clear();
+}
+
+void AppSearchIndex::match_trigrams(const std::string& query) {
+    std::vector<uint32_t> grams;
+    grams.reserve(query.size());
+    for (size_t i = 0; i + 3 <= query.size(); i++) {
+        uint32_t gram = trigram(query, i);
+        if (std::find(grams.begin(), grams.end(), gram) == grams.end())
+            grams.push_back(gram);
+    }
+
+    for (uint32_t gram : grams) {
+        auto it = m_trigrams.find(gram);
+        if (it == m_trigrams.end())
+            continue;
+
+        for (uint32_t app : it->second) {
+            if (m_hits[app]++ == 0)
+                m_touched.push_back(app);
+        }
+    }
+
+    // A wrong letter costs up to three trigrams, so accept titles sharing
+    // at least half of them
+    size_t needed = grams.size() - grams.size() / 2;
+
+    for (uint32_t app : m_touched) {
+        size_t hits = m_hits[app];
+        m_hits[app] = 0;
+        if (hits < needed)
+            continue;
+
+        int rank = 3 + (int)(grams.size() - hits);
+        if (hits == grams.size()) {
+            const std::string& name = m_names[app];
+            size_t position = name.find(query);
+            if (position == 0) {
+                rank = 0;
+            } else if (position != std::string::npos) {
+                rank = 2;
+                for (; position != std::string::npos;
+                     position = name.find(query, position + 1)) {
+                    if (name[position - 1] == ' ') {
+                        rank = 1;
+                        break;
+                    }
+                }
+            }
+        }
+
+        m_ranked.push_back({rank, app});
+    }
+    m_touched.clear();
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "GameStreamClient.hpp"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Fuzzy, case and diacritic insensitive search over one app list. Built
+// once per list; a query only walks the posting lists of its own trigrams
+// or a range of the sorted word table, never every title.
+class AppSearchIndex {
+  public:
+    AppSearchIndex() = default;
+    explicit AppSearchIndex(const AppInfoList& apps);
+
+    // Indices into the app list, best match first. An empty query matches
+    // every app in list order.
+    const std::vector<size_t>& search(const std::string& query);
+
+    // Lowercases, strips Latin diacritics and turns punctuation into
+    // single spaces
+    static std::string fold(const std::string& text);
+
+  private:
+    struct Word {
+        std::string text;
+        uint32_t app;
+        bool first;
+
+        bool operator<(const Word& other) const { return text < other.text; }
+    };
+
+    void match_prefix(const std::string& query);
+    void match_trigrams(const std::string& query);
+
+    std::vector<std::string> m_names;
+    std::vector<Word> m_words;
+    std::unordered_map<uint32_t, std::vector<uint32_t>> m_trigrams;
+
+    // Scratch space reused by every query
+    std::vector<uint16_t> m_hits;
+    std::vector<uint32_t> m_touched;
+    std::vector<std::pair<int, size_t>> m_ranked;
+
+    std::string m_last_query = "\n";
+    std::vector<size_t> m_result;
+};
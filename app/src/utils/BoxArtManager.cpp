@@ -1,84 +1,618 @@
 #include "BoxArtManager.hpp"
+#include "CryptoManager.hpp"
 #include "Data.hpp"
 #include "Settings.hpp"
 #include "nanovg.h"
-#include <mutex>
+#include <borealis.hpp>
 #include <CImg.h>
+#include <atomic>
+#include <cctype>
+#include <cstring>
+#include <ctime>
+#include <sys/stat.h>
 
-std::mutex m_mutex;
+#if defined(__linux__) || defined(__APPLE__)
+#define BOXART_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
-bool BoxArtManager::has_boxart(int app_id) {
-    if (m_has_boxart.count(app_id)) {
-        return m_has_boxart[app_id];
+using namespace cimg_library;
+
+using Clock = std::chrono::steady_clock;
+
+// Box art is stored as raw RGBA behind a small header, so loading it is a
+// map (or a single read) instead of a PNG decode
+static const uint32_t boxart_magic = 0x4142474D; // "MGBA"
+static const uint32_t boxart_version = 1;
+
+struct BoxArtHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+};
+
+// Manifest layout: magic, version, entry count, then per entry the key,
+// the hash (both as 32 bit length + bytes), width, height and a 64 bit
+// timestamp. Integers are native endian.
+static const uint32_t manifest_magic = 0x4D424C4D; // "MLBM"
+static const uint32_t manifest_version = 1;
+
+// Art recorded within this window is written to the manifest in one go
+static const long manifest_save_delay_ms = 1000;
+
+// Loads the request queue keeps going at once
+#if defined(__SWITCH__)
+static const size_t max_running_requests = 2;
+#else
+static const size_t max_running_requests = 4;
+#endif
+
+// Textures drawn this recently are on screen and never evicted
+static const std::chrono::milliseconds texture_grace(500);
+
+// Texture memory kept before the least recently drawn art is freed, unless
+// the settings ask for another amount
+#if defined(__SWITCH__)
+static const size_t default_texture_budget = 64 * 1024 * 1024;
+#else
+static const size_t default_texture_budget = 256 * 1024 * 1024;
+#endif
+
+static std::chrono::microseconds elapsed_since(Clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        Clock::now() - start);
+}
+
+// Hosts sharing art process the same hash at the same time, so scratch
+// files get a per-run serial on top of the final path
+static std::string scratch_path(const std::string& path,
+                                const std::string& suffix) {
+    static std::atomic<uint64_t> serial{0};
+    return path + "." + std::to_string(serial++) + suffix;
+}
+
+static bool file_exists(const std::string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && st.st_size > 0;
+}
+
+// CImg keeps channels in separate planes, textures want them interleaved
+static void copy_pixels(const CImg<unsigned char>& pic, BoxArtImage* image) {
+    image->width = pic.width();
+    image->height = pic.height();
+    auto pixels = std::make_shared<Data>((size_t)pic.width() * pic.height() * 4);
+    image->pixels = std::shared_ptr<const unsigned char>(pixels, pixels->bytes());
+
+    int channels = pic.spectrum();
+    unsigned char* dst = pixels->bytes();
+    for (int y = 0; y < pic.height(); y++) {
+        for (int x = 0; x < pic.width(); x++) {
+            *dst++ = pic(x, y, 0, 0);
+            *dst++ = pic(x, y, 0, channels > 1 ? 1 : 0);
+            *dst++ = pic(x, y, 0, channels > 2 ? 2 : 0);
+            *dst++ = channels > 3 ? pic(x, y, 0, 3) : 255;
+        }
     }
+}
 
-    std::string path = Settings::instance().boxart_dir() + "/" +
-                       std::to_string(app_id) + ".png";
-    Data data = Data::read_from_file(path);
-    m_has_boxart[app_id] = !data.is_empty();
+// Art stored by older versions, one file per app id of whichever host
+// was asked last
+static void remove_legacy_files(int app_id) {
+    std::string path =
+        Settings::instance().boxart_dir() + "/" + std::to_string(app_id);
+    remove((path + ".png").c_str());
+    remove((path + ".rgba").c_str());
+}
+
+static std::string content_hash(const Data& data) {
+    Data hex = CryptoManager::SHA256_hash_data(data).hex();
+    std::string hash((const char*)hex.bytes(), 32);
+    for (char& c : hash)
+        c = (char)tolower((unsigned char)c);
+    return hash;
+}
+
+BoxArtManager::BoxArtManager() {
+    set_texture_budget((size_t)Settings::instance().boxart_texture_budget() * 1024 * 1024);
+    load_manifest();
+}
+
+void BoxArtManager::set_texture_budget(size_t bytes) {
+    m_texture_budget = bytes > 0 ? bytes : default_texture_budget;
+    evict_textures("");
+}
+
+std::string BoxArtManager::manifest_key(const Host& host, int app_id) {
+    const std::string& id = host.uniqueid.empty() ? host.address : host.uniqueid;
+    return id + "/" + std::to_string(app_id);
+}
+
+bool BoxArtManager::has_boxart(const Host& host, int app_id) {
+    return m_manifest.count(manifest_key(host, app_id)) > 0;
+}
+
+void BoxArtManager::load(const Host& host, int app_id,
+                         ServerCallback<BoxArtImage>& callback) {
+    std::string key = manifest_key(host, app_id);
+
+    auto& pending = m_pending[key];
+    pending.push_back(callback);
+    if (pending.size() > 1)
+        return;
+
+    auto start = Clock::now();
+
+    auto entry = m_manifest.find(key);
+    if (entry == m_manifest.end()) {
+        fetch(host, app_id, key, start);
+        return;
+    }
+
+    std::string hash = entry->second.hash;
+    brls::async([this, host, app_id, key, hash, start] {
+        BoxArtImage image;
+        auto decodeStart = Clock::now();
+        bool loaded = read_container(get_texture_path(hash), &image);
+        image.hash = hash;
+
+        if (loaded) {
+            {
+                std::lock_guard<std::mutex> guard(m_timings_mutex);
+                m_timings.decode += elapsed_since(decodeStart);
+                m_timings.total += elapsed_since(start);
+                m_timings.loaded++;
+            }
+
+            brls::sync([this, key, image] {
+                finish(key, GSResult<BoxArtImage>::success(image));
+            });
+            return;
+        }
+
+        // The manifest points at a file that is gone, ask the host again
+        brls::sync([this, host, app_id, key, start] {
+            m_manifest.erase(key);
+            fetch(host, app_id, key, start);
+        });
+    });
+}
+
+uint64_t BoxArtManager::request(const Host& host, int app_id, int priority,
+                               ServerCallback<BoxArtImage>& callback) {
+    uint64_t ticket = m_next_ticket++;
+    m_queue[ticket] = {host, app_id, priority, callback};
+    pump();
+    return ticket;
+}
+
+void BoxArtManager::reprioritize(uint64_t ticket, int priority) {
+    auto it = m_queue.find(ticket);
+    if (it != m_queue.end())
+        it->second.priority = priority;
+}
+
+void BoxArtManager::cancel(uint64_t ticket) {
+    m_queue.erase(ticket);
+
+    // A running load cannot be stopped, but its result is dropped. It
+    // keeps its slot until it is done.
+    auto it = m_running.find(ticket);
+    if (it != m_running.end())
+        it->second = nullptr;
+}
+
+void BoxArtManager::pump() {
+    while (m_running.size() < max_running_requests && !m_queue.empty()) {
+        // Ties go to the oldest ticket
+        auto next = m_queue.begin();
+        for (auto it = m_queue.begin(); it != m_queue.end(); it++) {
+            if (it->second.priority < next->second.priority)
+                next = it;
+        }
+
+        uint64_t ticket = next->first;
+        Request request = std::move(next->second);
+        m_queue.erase(next);
+        m_running[ticket] = request.callback;
+
+        load(request.host, request.app_id,
+             [this, ticket](const GSResult<BoxArtImage>& result) {
+                 auto callback = std::move(m_running[ticket]);
+                 m_running.erase(ticket);
+                 if (callback)
+                     callback(result);
+                 pump();
+                 if (m_queue.empty() && m_running.empty())
+                     log_stats();
+             });
+    }
+}
+
+void BoxArtManager::log_stats() {
+    std::lock_guard<std::mutex> guard(m_timings_mutex);
+    brls::Logger::info("BoxArtManager: {} fetched, {} loaded so far; fetch {} "
+                       "ms, decode {} ms, resize {} ms, store {} ms, total {} "
+                       "ms; {} textures in {} KiB",
+                       m_timings.fetched, m_timings.loaded,
+                       m_timings.fetch.count() / 1000,
+                       m_timings.decode.count() / 1000,
+                       m_timings.resize.count() / 1000,
+                       m_timings.store.count() / 1000,
+                       m_timings.total.count() / 1000, m_textures.size(),
+                       m_texture_bytes / 1024);
+}
+
+void BoxArtManager::fetch(const Host& host, int app_id, const std::string& key,
+                          Clock::time_point start) {
+    GameStreamClient::instance().app_boxart(
+        host.address, app_id,
+        [this, app_id, key, start](const GSResult<Data>& result) {
+            if (!result.isSuccess()) {
+                finish(key, GSResult<BoxArtImage>::failure(result.error()));
+                return;
+            }
+
+            remove_legacy_files(app_id);
+
+            auto fetch = elapsed_since(start);
+            Data data = result.value();
+            brls::async([this, key, data, start, fetch] {
+                process(key, data, start, fetch);
+            });
+        });
+}
+
+void BoxArtManager::process(const std::string& key, Data data,
+                            Clock::time_point start,
+                            std::chrono::microseconds fetch) {
+    BoxArtTimings timings;
+    timings.fetch = fetch;
 
-    return m_has_boxart[app_id];
+    std::string hash = content_hash(data);
+    std::string path = get_texture_path(hash);
+
+    // Another host already served the very same art
+    BoxArtImage image;
+    bool processed = read_container(path, &image);
+
+    if (!processed) {
+        std::string raw = scratch_path(path, ".download.png");
+
+        auto storeStart = Clock::now();
+        data.write_to_file(raw);
+        timings.store += elapsed_since(storeStart);
+
+        processed = compress_texture(raw, path, &image, &timings);
+        remove(raw.c_str());
+    }
+
+    image.hash = hash;
+    timings.total = elapsed_since(start);
+
+    brls::Logger::debug("BoxArtManager: {} ({}) fetch {} us, decode {} us, "
+                        "resize {} us, store {} us, total {} us",
+                        key, hash, timings.fetch.count(),
+                        timings.decode.count(), timings.resize.count(),
+                        timings.store.count(), timings.total.count());
+
+    {
+        std::lock_guard<std::mutex> guard(m_timings_mutex);
+        m_timings.fetch += timings.fetch;
+        m_timings.decode += timings.decode;
+        m_timings.resize += timings.resize;
+        m_timings.store += timings.store;
+        m_timings.total += timings.total;
+        m_timings.fetched++;
+    }
+
+    brls::sync([this, key, image, processed] {
+        if (processed) {
+            record(key, image);
+            finish(key, GSResult<BoxArtImage>::success(image));
+        } else {
+            finish(key, GSResult<BoxArtImage>::failure(
+                            "Failed to decode box art"));
+        }
+    });
+}
+
+void BoxArtManager::finish(const std::string& key,
+                           const GSResult<BoxArtImage>& result) {
+    auto callbacks = std::move(m_pending[key]);
+    m_pending.erase(key);
+
+    for (auto& callback : callbacks)
+        callback(result);
+}
+
+void BoxArtManager::record(const std::string& key, const BoxArtImage& image) {
+    m_manifest[key] = {image.hash, image.width, image.height,
+                       (int64_t)time(nullptr)};
+    m_manifest_generation++;
+
+    if (m_manifest_save_scheduled)
+        return;
+
+    m_manifest_save_scheduled = true;
+    brls::delay(manifest_save_delay_ms, [this] {
+        m_manifest_save_scheduled = false;
+        save_manifest();
+    });
 }
 
-void BoxArtManager::set_data(Data data, int app_id) {
-    std::lock_guard<std::mutex> guard(m_mutex);
+void BoxArtManager::load_manifest() {
+    Data data = Data::read_from_file(Settings::instance().boxart_dir() +
+                                     "/manifest.bin");
+    const unsigned char* bytes = data.bytes();
+    size_t size = data.size();
+    size_t offset = 0;
+
+    auto read = [&](void* value, size_t length) {
+        if (offset + length > size)
+            return false;
+        memcpy(value, bytes + offset, length);
+        offset += length;
+        return true;
+    };
 
-    std::string path = Settings::instance().boxart_dir() + "/" +
-                       std::to_string(app_id) + ".png";
+    auto read_string = [&](std::string* value) {
+        uint32_t length;
+        if (!read(&length, sizeof(length)) || offset + length > size)
+            return false;
+        value->assign((const char*)bytes + offset, length);
+        offset += length;
+        return true;
+    };
 
-    data.write_to_file(path);
-    compress_texture(path);
+    uint32_t magic, version, count;
+    if (!read(&magic, sizeof(magic)) || !read(&version, sizeof(version)) ||
+        !read(&count, sizeof(count)))
+        return;
+
+    if (magic != manifest_magic || version != manifest_version) {
+        brls::Logger::error("BoxArtManager: Ignoring unknown manifest");
+        return;
+    }
 
-    m_has_boxart[app_id] = true;
+    for (uint32_t i = 0; i < count; i++) {
+        std::string key;
+        ManifestEntry entry;
+        uint32_t width, height;
+        if (!read_string(&key) || !read_string(&entry.hash) ||
+            !read(&width, sizeof(width)) || !read(&height, sizeof(height)) ||
+            !read(&entry.timestamp, sizeof(entry.timestamp))) {
+            brls::Logger::error("BoxArtManager: Truncated manifest");
+            return;
+        }
+
+        entry.width = (int)width;
+        entry.height = (int)height;
+        m_manifest[key] = entry;
+    }
+
+    brls::Logger::info("BoxArtManager: {} box art entries in the manifest",
+                       m_manifest.size());
 }
 
-void BoxArtManager::compress_texture(const std::string& path) {
-    using namespace cimg_library;
+void BoxArtManager::save_manifest() {
+    DataBuilder builder;
+    auto append_string = [&](const std::string& value) {
+        uint32_t length = (uint32_t)value.size();
+        builder.append(&length, sizeof(length));
+        builder.append(value.data(), length);
+    };
+
+    uint32_t count = (uint32_t)m_manifest.size();
+    builder.append(&manifest_magic, sizeof(manifest_magic));
+    builder.append(&manifest_version, sizeof(manifest_version));
+    builder.append(&count, sizeof(count));
+
+    for (const auto& [key, entry] : m_manifest) {
+        uint32_t width = entry.width, height = entry.height;
+        append_string(key);
+        append_string(entry.hash);
+        builder.append(&width, sizeof(width));
+        builder.append(&height, sizeof(height));
+        builder.append(&entry.timestamp, sizeof(entry.timestamp));
+    }
+
+    Data data = builder.build();
+    std::string file = Settings::instance().boxart_dir() + "/manifest.bin";
+    uint64_t generation = m_manifest_generation;
 
+    brls::async([this, data, file, generation] {
+        std::lock_guard<std::mutex> guard(m_manifest_mutex);
+
+        // A newer snapshot got here first
+        if (generation <= m_manifest_written)
+            return;
+        m_manifest_written = generation;
+
+        std::string tmp = scratch_path(file, ".tmp");
+        data.write_to_file(tmp);
+        if (rename(tmp.c_str(), file.c_str()) != 0) {
+            remove(file.c_str());
+            rename(tmp.c_str(), file.c_str());
+        }
+    });
+}
+
+bool BoxArtManager::compress_texture(const std::string& source,
+                                     const std::string& path,
+                                     BoxArtImage* image,
+                                     BoxArtTimings* timings) {
     /*
      * target width == 300
      * target height == 400
      * 0.75 == 300 / 400
      */
 
-    CImg<unsigned char> pic(path.c_str());
-    if (float(pic.width()) / float(pic.height()) < 0.75f) {
-        pic = pic.resize(300, int(float(pic.height()) * 300.0f / float(pic.width())), 1, 3);
-    } else {
-        pic = pic.resize(int(float(pic.width()) * 400.0f / float(pic.height())), 400, 1, 3);
+    try {
+        auto stageStart = Clock::now();
+        CImg<unsigned char> pic(source.c_str());
+        timings->decode += elapsed_since(stageStart);
+
+        stageStart = Clock::now();
+        if (float(pic.width()) / float(pic.height()) < 0.75f) {
+            pic = pic.resize(300, int(float(pic.height()) * 300.0f / float(pic.width())), 1, 3);
+        } else {
+            pic = pic.resize(int(float(pic.width()) * 400.0f / float(pic.height())), 400, 1, 3);
+        }
+        timings->resize += elapsed_since(stageStart);
+
+        stageStart = Clock::now();
+        copy_pixels(pic, image);
+        bool stored = write_container(path, *image);
+        timings->store += elapsed_since(stageStart);
+        return stored;
+    } catch (const CImgException& e) {
+        brls::Logger::error("BoxArtManager: Failed to process {}: {}", source,
+                            e.what());
+        return false;
     }
-    pic.save(path.c_str());
 }
 
-std::string BoxArtManager::get_texture_path(int app_id) {
-    return Settings::instance().boxart_dir() + "/" + std::to_string(app_id) +
-           ".png";
+bool BoxArtManager::write_container(const std::string& path,
+                                    const BoxArtImage& image) {
+    BoxArtHeader header = {boxart_magic, boxart_version,
+                           (uint32_t)image.width, (uint32_t)image.height};
+
+    // Write next to the final path first so a reader never maps a
+    // half-written file
+    std::string tmp = scratch_path(path, ".tmp");
+    FILE* f = fopen(tmp.c_str(), "wb");
+    if (!f) {
+        brls::Logger::error("BoxArtManager: Failed to write {}", tmp);
+        return false;
+    }
+
+    bool written = fwrite(&header, sizeof(header), 1, f) == 1 &&
+                   fwrite(image.pixels.get(), image.size(), 1, f) == 1;
+    written = fclose(f) == 0 && written;
+
+    // Windows refuses to rename over a file that a parallel load of the
+    // same art has just stored
+    bool stored = written && (rename(tmp.c_str(), path.c_str()) == 0 ||
+                              file_exists(path));
+    if (!stored)
+        brls::Logger::error("BoxArtManager: Failed to write {}", path);
+    remove(tmp.c_str());
+    return stored;
+}
+
+static bool valid_header(const BoxArtHeader& header, size_t size) {
+    return header.magic == boxart_magic && header.version == boxart_version &&
+           header.width > 0 && header.height > 0 &&
+           size == sizeof(BoxArtHeader) +
+                       (size_t)header.width * header.height * 4;
 }
 
-void BoxArtManager::make_texture_from_boxart(NVGcontext* ctx, int app_id) {
-    std::lock_guard<std::mutex> guard(m_mutex);
+bool BoxArtManager::read_container(const std::string& path,
+                                   BoxArtImage* image) {
+#ifdef BOXART_MMAP
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(BoxArtHeader)) {
+        close(fd);
+        return false;
+    }
+
+    size_t size = (size_t)st.st_size;
+    void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return false;
 
-    std::string path = Settings::instance().boxart_dir() + "/" +
-                       std::to_string(app_id) + ".png";
+    BoxArtHeader header;
+    memcpy(&header, map, sizeof(header));
+    if (!valid_header(header, size)) {
+        brls::Logger::error("BoxArtManager: Invalid box art file {}", path);
+        munmap(map, size);
+        return false;
+    }
+
+    // The mapping lives as long as the last copy of the pixels
+    auto mapping = std::shared_ptr<void>(
+        map, [size](void* map) { munmap(map, size); });
+    image->pixels = std::shared_ptr<const unsigned char>(
+        mapping, (const unsigned char*)map + sizeof(header));
+#else
     Data data = Data::read_from_file(path);
+    if (data.size() < sizeof(BoxArtHeader))
+        return false;
 
-    if (data.is_empty()) {
-        m_has_boxart[app_id] = false;
-        return;
+    BoxArtHeader header;
+    memcpy(&header, data.bytes(), sizeof(header));
+    if (!valid_header(header, data.size())) {
+        brls::Logger::error("BoxArtManager: Invalid box art file {}", path);
+        return false;
     }
 
-    int handle = nvgCreateImageMem(ctx, 0, data.bytes(), (int)data.size());
+    auto pixels = std::make_shared<Data>(data);
+    image->pixels = std::shared_ptr<const unsigned char>(
+        pixels, pixels->bytes() + sizeof(header));
+#endif
+
+    image->width = (int)header.width;
+    image->height = (int)header.height;
+    return true;
+}
+
+std::string BoxArtManager::get_texture_path(const std::string& hash) {
+    return Settings::instance().boxart_dir() + "/" + hash + ".rgba";
+}
 
-    if (handle > 0) {
-        m_texture_handle[app_id] = handle;
-    } else {
-        m_has_boxart[app_id] = false;
+int BoxArtManager::make_texture(NVGcontext* ctx, const BoxArtImage& image) {
+    auto it = m_textures.find(image.hash);
+    if (it != m_textures.end()) {
+        touch_texture(image.hash);
+        return it->second.handle;
     }
+
+    int handle =
+        nvgCreateImageRGBA(ctx, image.width, image.height, 0, image.pixels.get());
+    if (handle <= 0)
+        return 0;
+
+    m_texture_context = ctx;
+    m_texture_order.push_front(image.hash);
+    m_textures[image.hash] = {handle, image.size(), Clock::now(),
+                              m_texture_order.begin()};
+    m_texture_bytes += image.size();
+
+    evict_textures(image.hash);
+    return handle;
 }
 
-int BoxArtManager::texture_id(int app_id) {
-    if (m_texture_handle.count(app_id)) {
-        return m_texture_handle[app_id];
+bool BoxArtManager::touch_texture(const std::string& hash) {
+    auto it = m_textures.find(hash);
+    if (it == m_textures.end())
+        return false;
+
+    it->second.used = Clock::now();
+    m_texture_order.splice(m_texture_order.begin(), m_texture_order,
+                           it->second.order);
+    return true;
+}
+
+void BoxArtManager::evict_textures(const std::string& keep) {
+    auto now = Clock::now();
+
+    while (m_texture_bytes > m_texture_budget && !m_texture_order.empty()) {
+        std::string hash = m_texture_order.back();
+        Texture& texture = m_textures[hash];
+        if (hash == keep || now - texture.used < texture_grace)
+            break;
+
+        nvgDeleteImage(m_texture_context, texture.handle);
+        m_texture_bytes -= texture.bytes;
+        m_texture_order.pop_back();
+        m_textures.erase(hash);
     }
-    return -1;
 }
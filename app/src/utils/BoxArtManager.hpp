@@ -1,24 +1,147 @@
+#include "Data.hpp"
+#include "GameStreamClient.hpp"
 #include "Singleton.hpp"
+#include <chrono>
+#include <list>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <set>
 #include <cstdio>
 #include <string>
+#include <unordered_map>
 #include <vector>
 #pragma once
 
 struct NVGcontext;
-struct Data;
+
+// Decoded box art, ready to be uploaded as a texture
+struct BoxArtImage {
+    // RGBA, 4 bytes per pixel. Either owned or mapped from the cache file.
+    std::shared_ptr<const unsigned char> pixels;
+    int width = 0;
+    int height = 0;
+    // Content hash, shared by every host serving the same art
+    std::string hash;
+
+    size_t size() const { return (size_t)width * height * 4; }
+};
+
+// Accumulated time spent in every stage of the box art pipeline
+struct BoxArtTimings {
+    std::chrono::microseconds fetch{0};
+    std::chrono::microseconds decode{0};
+    std::chrono::microseconds resize{0};
+    std::chrono::microseconds store{0};
+    std::chrono::microseconds total{0};
+    size_t fetched = 0;
+    size_t loaded = 0;
+};
 
 class BoxArtManager : public Singleton<BoxArtManager> {
   public:
-    bool has_boxart(int app_id);
+    BoxArtManager();
+
+    // Answered from the manifest, never touches the disk
+    bool has_boxart(const Host& host, int app_id);
 
-    void set_data(Data data, int app_id);
-    static std::string get_texture_path(int app_id);
-    void make_texture_from_boxart(NVGcontext* ctx, int app_id);
-    int texture_id(int app_id);
+    // Fetches the art if it is not stored yet, then decodes, resizes and
+    // stores it on worker threads. Only the finished pixels reach the UI
+    // thread.
+    void load(const Host& host, int app_id, ServerCallback<BoxArtImage>& callback);
+
+    // Queues a load. Queued loads start lowest priority first and only a
+    // few run at once. The returned ticket is used to reprioritize or
+    // cancel it; a cancelled request never calls back.
+    uint64_t request(const Host& host, int app_id, int priority,
+                     ServerCallback<BoxArtImage>& callback);
+    void reprioritize(uint64_t ticket, int priority);
+    void cancel(uint64_t ticket);
+
+    static std::string get_texture_path(const std::string& hash);
+
+    // Uploads the art into a NanoVG texture owned by the manager. Textures
+    // are kept in LRU order and the least recently drawn ones are freed once
+    // the budget is exceeded.
+    int make_texture(NVGcontext* ctx, const BoxArtImage& image);
+    // Marks the texture as drawn. False if it was evicted meanwhile.
+    bool touch_texture(const std::string& hash);
+    // 0 restores the platform default
+    void set_texture_budget(size_t bytes);
 
   private:
-    std::map<int, bool> m_has_boxart;
-    std::map<int, int> m_texture_handle;
-    static void compress_texture(const std::string& path);
+    // What is stored for an app of a host, keyed by "<host>/<app_id>"
+    struct ManifestEntry {
+        std::string hash;
+        int width;
+        int height;
+        int64_t timestamp;
+    };
+
+    static std::string manifest_key(const Host& host, int app_id);
+
+    void load_manifest();
+    void save_manifest();
+    void record(const std::string& key, const BoxArtImage& image);
+
+    void fetch(const Host& host, int app_id, const std::string& key,
+               std::chrono::steady_clock::time_point start);
+    void process(const std::string& key, Data data,
+                 std::chrono::steady_clock::time_point start,
+                 std::chrono::microseconds fetch);
+    void finish(const std::string& key, const GSResult<BoxArtImage>& result);
+
+    struct Texture {
+        int handle;
+        size_t bytes;
+        std::chrono::steady_clock::time_point used;
+        std::list<std::string>::iterator order;
+    };
+
+    void evict_textures(const std::string& keep);
+
+    struct Request {
+        Host host;
+        int app_id;
+        int priority;
+        std::function<void(GSResult<BoxArtImage>)> callback;
+    };
+
+    void pump();
+    // Logs the pipeline totals and texture memory once the queue drains
+    void log_stats();
+
+    // UI thread only
+    std::map<uint64_t, Request> m_queue;
+    std::map<uint64_t, std::function<void(GSResult<BoxArtImage>)>> m_running;
+    uint64_t m_next_ticket = 1;
+
+    // UI thread only
+    std::unordered_map<std::string, ManifestEntry> m_manifest;
+    uint64_t m_manifest_generation = 0;
+    bool m_manifest_save_scheduled = false;
+    // Serializes manifest writes on worker threads and guards
+    // m_manifest_written, the newest generation on disk
+    std::mutex m_manifest_mutex;
+    uint64_t m_manifest_written = 0;
+
+    std::map<std::string, Texture> m_textures;
+    std::list<std::string> m_texture_order;
+    size_t m_texture_bytes = 0;
+    size_t m_texture_budget = 0;
+    NVGcontext* m_texture_context = nullptr;
+    // Callbacks waiting for the art that is being loaded, UI thread only
+    std::map<std::string,
+             std::vector<std::function<void(GSResult<BoxArtImage>)>>>
+        m_pending;
+
+    std::mutex m_timings_mutex;
+    BoxArtTimings m_timings;
+
+    static bool compress_texture(const std::string& source,
+                                 const std::string& path, BoxArtImage* image,
+                                 BoxArtTimings* timings);
+    static bool write_container(const std::string& path,
+                                const BoxArtImage& image);
+    static bool read_container(const std::string& path, BoxArtImage* image);
 };
@@ -4,6 +4,7 @@
 #include <cstring>
 #include <iomanip>
 #include <climits>
+#include <cstdlib>
 #include <sys/stat.h>
 
 using namespace brls;
@@ -19,6 +20,13 @@ static int mkdir(const char* dir, mode_t mode) {
 #define PATH_MAX 1024
 #endif
 
+using Clock = std::chrono::steady_clock;
+
+// Saves are written once no new one came in for save_debounce, but never
+// later than save_max_delay after the first unwritten one
+static const std::chrono::milliseconds save_debounce(500);
+static const std::chrono::milliseconds save_max_delay(2000);
+
 std::string getVideoCodecName(VideoCodec codec) {
     switch (codec) {
         case H264:
@@ -62,12 +70,14 @@ void Settings::set_working_dir(const std::string& working_dir) {
     m_working_dir = working_dir;
     m_key_dir = working_dir + "/key";
     m_boxart_dir = working_dir + "/boxart";
+    m_app_list_dir = working_dir + "/applist";
     m_log_path = working_dir + "/log.log";
     m_gamepad_mapping_path = working_dir + "/gamepad_mapping_v1.2.0.json";
     
     mkdirtree(m_working_dir.c_str());
     mkdirtree(m_key_dir.c_str());
     mkdirtree(m_boxart_dir.c_str());
+    mkdirtree(m_app_list_dir.c_str());
     
     load();
 }
@@ -81,6 +91,8 @@ void Settings::add_host(const Host& host) {
         it->address = host.address;
         it->hostname = host.hostname;
         it->mac = host.mac;
+        if (!host.uniqueid.empty())
+            it->uniqueid = host.uniqueid;
     } else if (!host.address.empty() && !host.mac.empty()) {
         m_hosts.push_back(host);
     }
@@ -190,6 +202,12 @@ void Settings::load() {
                             }
                         }
 
+                        if (json_t* uniqueid = json_object_get(json, "uniqueid")) {
+                            if (json_typeof(uniqueid) == JSON_STRING) {
+                                host.uniqueid = json_string_value(uniqueid);
+                            }
+                        }
+
                         if (json_t* favorites = json_object_get(json, "favorites")) {
                             size_t size = json_array_size(favorites);
                             for (size_t i = 0; i < size; i++) {
@@ -266,6 +284,18 @@ void Settings::load() {
                 }
             }
 
+            if (json_t* input_poll_rate = json_object_get(settings, "input_poll_rate")) {
+                if (json_typeof(input_poll_rate) == JSON_INTEGER) {
+                    m_input_poll_rate = std::clamp((int)json_integer_value(input_poll_rate), 0, 1000);
+                }
+            }
+
+            if (json_t* boxart_texture_budget = json_object_get(settings, "boxart_texture_budget")) {
+                if (json_typeof(boxart_texture_budget) == JSON_INTEGER) {
+                    m_boxart_texture_budget = std::clamp((int)json_integer_value(boxart_texture_budget), 0, 4096);
+                }
+            }
+
             if (json_t* frames_queue_size = json_object_get(settings, "frames_queue_size")) {
                 if (json_typeof(frames_queue_size) == JSON_INTEGER) {
                     m_frames_queue_size = (int)json_integer_value(frames_queue_size);
@@ -462,9 +492,156 @@ void Settings::load() {
         
         json_decref(root);
     }
+
+    publish();
+}
+
+Settings::Settings()
+    : m_snapshot(std::make_shared<const SettingsSnapshot>()) {}
+
+void Settings::publish() {
+    std::shared_ptr<const SettingsSnapshot> current = snapshot();
+
+    SettingsSnapshot next;
+    next.version = current->version;
+    next.audio_backend = m_audio_backend;
+    next.volume = m_volume;
+    next.decoder_threads = m_decoder_threads;
+    next.frames_queue_size = m_frames_queue_size;
+    next.use_hw_decoding = use_hw_decoding();
+    next.mouse_speed_multiplier = m_mouse_speed_multiplier;
+    next.rumble_force = get_rumble_force();
+    next.deadzone_stick_left = m_deadzone_stick_left;
+    next.deadzone_stick_right = m_deadzone_stick_right;
+    next.touchscreen_mouse_mode = m_touchscreen_mouse_mode;
+    next.swap_mouse_keys = m_swap_mouse_keys;
+    next.swap_mouse_scroll = m_swap_mouse_scroll;
+
+    if (next == *current)
+        return;
+
+    next.version++;
+    auto published = std::make_shared<const SettingsSnapshot>(next);
+#if defined(__cpp_lib_atomic_shared_ptr)
+    m_snapshot.store(std::move(published), std::memory_order_release);
+#else
+    std::atomic_store_explicit(&m_snapshot, std::move(published),
+                               std::memory_order_release);
+#endif
+}
+
+Settings::~Settings() {
+    flush();
+
+    {
+        std::lock_guard<std::mutex> guard(m_save_mutex);
+        m_writer_running = false;
+    }
+    m_save_condition.notify_all();
+    if (m_writer.joinable())
+        m_writer.join();
 }
 
 void Settings::save() {
+    std::string content = serialize();
+    if (content.empty())
+        return;
+
+    {
+        std::lock_guard<std::mutex> guard(m_save_mutex);
+        auto now = Clock::now();
+        if (!m_save_pending)
+            m_first_save_request = now;
+
+        m_pending_save = std::move(content);
+        m_last_save_request = now;
+        m_save_pending = true;
+        m_save_requests++;
+
+        if (!m_writer_running) {
+            m_writer_running = true;
+            m_writer = std::thread([this] { write_loop(); });
+        }
+    }
+    m_save_condition.notify_all();
+}
+
+void Settings::flush() {
+    std::unique_lock<std::mutex> lock(m_save_mutex);
+    if (m_save_pending)
+        write_pending(lock);
+}
+
+void Settings::write_loop() {
+    std::unique_lock<std::mutex> lock(m_save_mutex);
+    while (m_writer_running) {
+        if (!m_save_pending) {
+            m_save_condition.wait(lock);
+            continue;
+        }
+
+        auto deadline = std::min(m_last_save_request + save_debounce,
+                                 m_first_save_request + save_max_delay);
+        if (Clock::now() < deadline) {
+            m_save_condition.wait_until(lock, deadline);
+            continue;
+        }
+
+        write_pending(lock);
+    }
+}
+
+// Called with m_save_mutex held, returns with it held again
+void Settings::write_pending(std::unique_lock<std::mutex>& lock) {
+    // Taking the write lock before letting go of the pending content keeps
+    // writes in the order the saves came in
+    std::unique_lock<std::mutex> writeLock(m_write_mutex);
+    std::string content = std::move(m_pending_save);
+    size_t requests = m_save_requests;
+    m_pending_save.clear();
+    m_save_pending = false;
+    m_save_requests = 0;
+    lock.unlock();
+
+    auto start = Clock::now();
+    bool changed = content != m_saved;
+    if (changed) {
+        // Write aside and swap, so a crash never leaves a truncated file
+        std::string path = m_working_dir + "/settings.json";
+        std::string tmp = path + ".tmp";
+
+        FILE* f = fopen(tmp.c_str(), "wb");
+        bool written = f && fwrite(content.data(), 1, content.size(), f) ==
+                                content.size();
+        if (f)
+            written = fclose(f) == 0 && written;
+
+        if (written && rename(tmp.c_str(), path.c_str()) != 0) {
+            remove(path.c_str());
+            written = rename(tmp.c_str(), path.c_str()) == 0;
+        }
+
+        if (written) {
+            m_saved = std::move(content);
+        } else {
+            brls::Logger::error("Settings: Failed to write {}", path);
+            remove(tmp.c_str());
+        }
+    }
+
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(
+        Clock::now() - start);
+    writeLock.unlock();
+
+    if (changed)
+        brls::Logger::debug("Settings: Saved {} change(s) in {} us", requests,
+                            duration.count());
+
+    lock.lock();
+}
+
+std::string Settings::serialize() {
+    std::string content;
     json_t* root = json_object();
     
     if (root) {
@@ -474,6 +651,7 @@ void Settings::save() {
                     json_object_set_new(json, "address", json_string(host.address.c_str()));
                     json_object_set_new(json, "hostname", json_string(host.hostname.c_str()));
                     json_object_set_new(json, "mac", json_string(host.mac.c_str()));
+                    json_object_set_new(json, "uniqueid", json_string(host.uniqueid.c_str()));
                     if (json_t* apps = json_array()) {
                         for (auto app: host.favorites) {
                             if (json_t* jsonApp = json_object()) {
@@ -498,6 +676,8 @@ void Settings::save() {
             json_object_set_new(settings, "bitrate", json_integer(m_bitrate));
             json_object_set_new(settings, "decoder_threads", json_integer(m_decoder_threads));
             json_object_set_new(settings, "frames_queue_size", json_integer(m_frames_queue_size));
+            json_object_set_new(settings, "input_poll_rate", json_integer(m_input_poll_rate));
+            json_object_set_new(settings, "boxart_texture_budget", json_integer(m_boxart_texture_budget));
             json_object_set_new(settings, "enable_hdr", m_enable_hdr ? json_true() : json_false());
             json_object_set_new(settings, "click_by_tap", m_click_by_tap ? json_true() : json_false());
             json_object_set_new(settings, "use_hw_decoding", m_use_hw_decoding ? json_true() : json_false());
@@ -565,9 +745,13 @@ void Settings::save() {
             json_object_set_new(root, "mapping_layouts", hosts);
         }
         
-        json_dump_file(root, (m_working_dir + "/settings.json").c_str(), JSON_INDENT(4));
+        if (char* json = json_dumps(root, JSON_INDENT(4))) {
+            content = json;
+            free(json);
+        }
         json_decref(root);
     }
+    return content;
 }
 
 void Settings::loadBaseLayouts() {
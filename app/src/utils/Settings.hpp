@@ -1,10 +1,16 @@
 #pragma once
 
 #include "Singleton.hpp"
+#include <atomic>
 #include <borealis.hpp>
+#include <chrono>
+#include <condition_variable>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <cstdio>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -42,17 +48,55 @@ struct Host {
     std::string address;
     std::string hostname;
     std::string mac;
+    std::string uniqueid;
     std::vector<App> favorites;
 };
 
+// Settings read by the streaming threads. A published snapshot never
+// changes, so readers need no locks; Settings publishes a new one with a
+// higher version whenever one of these values is set.
+struct SettingsSnapshot {
+    uint64_t version = 0;
+    AudioBackend audio_backend = SDL;
+    int volume = 100;
+    int decoder_threads = 4;
+    int frames_queue_size = 3;
+    bool use_hw_decoding = true;
+    int mouse_speed_multiplier = 34;
+    float rumble_force = 1;
+    float deadzone_stick_left = 0;
+    float deadzone_stick_right = 0;
+    bool touchscreen_mouse_mode = false;
+    bool swap_mouse_keys = false;
+    bool swap_mouse_scroll = false;
+
+    bool operator==(const SettingsSnapshot&) const = default;
+};
+
 class Settings : public Singleton<Settings> {
   public:
+    Settings();
+    ~Settings();
+
+    // Current snapshot. A replaced one lives on until its last reader lets
+    // go of it.
+    [[nodiscard]] std::shared_ptr<const SettingsSnapshot> snapshot() const {
+#if defined(__cpp_lib_atomic_shared_ptr)
+        return m_snapshot.load(std::memory_order_acquire);
+#else
+        return std::atomic_load_explicit(&m_snapshot,
+                                         std::memory_order_acquire);
+#endif
+    }
+
     void set_working_dir(const std::string& working_dir);
 
     [[nodiscard]] std::string key_dir() const { return m_key_dir; }
 
     [[nodiscard]] std::string boxart_dir() const { return m_boxart_dir; }
 
+    [[nodiscard]] std::string app_list_dir() const { return m_app_list_dir; }
+
     [[nodiscard]] std::string log_path() const { return m_log_path; }
 
     [[nodiscard]] std::string gamepad_mapping_path() const { return m_gamepad_mapping_path; }
@@ -77,7 +121,7 @@ class Settings : public Singleton<Settings> {
     void set_video_codec(VideoCodec video_codec) { m_video_codec = video_codec; }
 
     [[nodiscard]] AudioBackend audio_backend() const { return m_audio_backend; }
-    void set_audio_backend(AudioBackend audio_backend) { m_audio_backend = audio_backend; }
+    void set_audio_backend(AudioBackend audio_backend) { m_audio_backend = audio_backend; publish(); }
 
     [[nodiscard]] int bitrate() const { return m_bitrate; }
     void set_bitrate(int bitrate) { m_bitrate = bitrate; }
@@ -94,10 +138,10 @@ class Settings : public Singleton<Settings> {
     [[nodiscard]] bool click_by_tap() const { return m_click_by_tap; }
     void set_click_by_tap(bool click_by_tap) { m_click_by_tap = click_by_tap; }
 
-    void set_decoder_threads(int decoder_threads) { m_decoder_threads = decoder_threads; }
+    void set_decoder_threads(int decoder_threads) { m_decoder_threads = decoder_threads; publish(); }
     [[nodiscard]] int decoder_threads() const { return m_decoder_threads; }
 
-    void set_frames_queue_size(int frames_queue_size) { m_frames_queue_size = frames_queue_size; }
+    void set_frames_queue_size(int frames_queue_size) { m_frames_queue_size = frames_queue_size; publish(); }
     [[nodiscard]] int frames_queue_size() const { return m_frames_queue_size; }
 
     void set_sops(bool sops) { m_sops = sops; }
@@ -112,16 +156,24 @@ class Settings : public Singleton<Settings> {
     void set_swap_ui_keys(bool swap_ui_keys) { m_swap_ui_keys = swap_ui_keys; }
     [[nodiscard]] bool swap_ui_keys() const { return m_swap_ui_keys; }
 
+    // Controller sampling rate in Hz, 0 samples once per rendered frame
+    void set_input_poll_rate(int input_poll_rate) { m_input_poll_rate = input_poll_rate; }
+    [[nodiscard]] int input_poll_rate() const { return m_input_poll_rate; }
+
+    // Box art texture memory in MiB, 0 keeps the platform default
+    void set_boxart_texture_budget(int boxart_texture_budget) { m_boxart_texture_budget = boxart_texture_budget; }
+    [[nodiscard]] int boxart_texture_budget() const { return m_boxart_texture_budget; }
+
     void set_swap_joycon_stick_to_dpad(bool value) { m_swap_joycon_stick_to_dpad = value; }
     [[nodiscard]] bool swap_joycon_stick_to_dpad() const { return m_swap_joycon_stick_to_dpad; }
 
-    void set_swap_mouse_keys(bool swap_mouse_keys) { m_swap_mouse_keys = swap_mouse_keys; }
+    void set_swap_mouse_keys(bool swap_mouse_keys) { m_swap_mouse_keys = swap_mouse_keys; publish(); }
     [[nodiscard]] bool touchscreen_mouse_mode() const { return m_touchscreen_mouse_mode; }
 
-    void set_touchscreen_mouse_mode(bool touchscreen_mouse_mode) { m_touchscreen_mouse_mode = touchscreen_mouse_mode; }
+    void set_touchscreen_mouse_mode(bool touchscreen_mouse_mode) { m_touchscreen_mouse_mode = touchscreen_mouse_mode; publish(); }
     [[nodiscard]] bool swap_mouse_keys() const { return m_swap_mouse_keys; }
 
-    void set_swap_mouse_scroll(bool swap_mouse_scroll) { m_swap_mouse_scroll = swap_mouse_scroll; }
+    void set_swap_mouse_scroll(bool swap_mouse_scroll) { m_swap_mouse_scroll = swap_mouse_scroll; publish(); }
     [[nodiscard]] bool swap_mouse_scroll() const { return m_swap_mouse_scroll; }
 
     void set_guide_key_options(KeyComboOptions options) { m_guide_key_options = std::move(options); }
@@ -136,10 +188,10 @@ class Settings : public Singleton<Settings> {
     void set_volume_amplification(bool allow) { m_volume_amplification = allow; }
     [[nodiscard]] bool get_volume_amplification() const { return m_volume_amplification; }
 
-    void set_volume(int volume) { m_volume = volume; }
+    void set_volume(int volume) { m_volume = volume; publish(); }
     [[nodiscard]] int get_volume() const { return m_volume; }
 
-    void set_use_hw_decoding(bool hw_decoding) { m_use_hw_decoding = hw_decoding; }
+    void set_use_hw_decoding(bool hw_decoding) { m_use_hw_decoding = hw_decoding; publish(); }
     [[nodiscard]] bool use_hw_decoding() const { return true; } //m_use_hw_decoding; }
 
     void set_keyboard_type(KeyboardType type) { m_keyboard_type = type; }
@@ -157,16 +209,16 @@ class Settings : public Singleton<Settings> {
     void set_keyboard_locale(int locale) { m_keyboard_locale = locale; }
     [[nodiscard]] int get_keyboard_locale() const { return m_keyboard_locale; }
 
-    void set_rumble_force(float rumble_force) { m_rumble_force = int(rumble_force * 100); }
+    void set_rumble_force(float rumble_force) { m_rumble_force = int(rumble_force * 100); publish(); }
     [[nodiscard]] float get_rumble_force() const { return float(m_rumble_force) / 100.f; }
 
-    void set_mouse_speed_multiplier(int mouse_speed_multiplier) { m_mouse_speed_multiplier = mouse_speed_multiplier; }
+    void set_mouse_speed_multiplier(int mouse_speed_multiplier) { m_mouse_speed_multiplier = mouse_speed_multiplier; publish(); }
     [[nodiscard]] int get_mouse_speed_multiplier() const { return m_mouse_speed_multiplier; }
 
-    void set_deadzone_stick_left(float deadzone) { m_deadzone_stick_left = deadzone; }
+    void set_deadzone_stick_left(float deadzone) { m_deadzone_stick_left = deadzone; publish(); }
     [[nodiscard]] float get_deadzone_stick_left() const { return m_deadzone_stick_left; }
 
-    void set_deadzone_stick_right(float deadzone) { m_deadzone_stick_right = deadzone; }
+    void set_deadzone_stick_right(float deadzone) { m_deadzone_stick_right = deadzone; publish(); }
     [[nodiscard]] float get_deadzone_stick_right() const { return m_deadzone_stick_right; }
 
     int get_current_mapping_layout();
@@ -175,12 +227,17 @@ class Settings : public Singleton<Settings> {
     std::vector<KeyMappingLayout>* get_mapping_laouts() { return &m_mapping_laouts; }
 
     void load();
+    // Serializes the settings and hands them to a writer thread, which
+    // writes them once changes stop coming in for a moment
     void save();
+    // Writes pending changes right away on the calling thread
+    void flush();
 
   private:
     std::string m_working_dir;
     std::string m_key_dir;
     std::string m_boxart_dir;
+    std::string m_app_list_dir;
     std::string m_log_path;
     std::string m_gamepad_mapping_path;
 
@@ -199,6 +256,8 @@ class Settings : public Singleton<Settings> {
     bool m_write_log = false;
     bool m_swap_ui_keys = false;
     bool m_swap_joycon_stick_to_dpad = false;
+    int m_input_poll_rate = 0;
+    int m_boxart_texture_budget = 0;
     bool m_touchscreen_mouse_mode = false;
     bool m_swap_mouse_keys = false;
     bool m_swap_mouse_scroll = false;
@@ -232,4 +291,30 @@ class Settings : public Singleton<Settings> {
     float m_deadzone_stick_right = 0;
 
     void loadBaseLayouts();
+    // UI thread only
+    void publish();
+
+#if defined(__cpp_lib_atomic_shared_ptr)
+    std::atomic<std::shared_ptr<const SettingsSnapshot>> m_snapshot;
+#else
+    // Only ever accessed through the std::atomic_* shared_ptr overloads
+    std::shared_ptr<const SettingsSnapshot> m_snapshot;
+#endif
+
+    std::string serialize();
+    void write_loop();
+    void write_pending(std::unique_lock<std::mutex>& lock);
+
+    std::thread m_writer;
+    std::mutex m_save_mutex;
+    std::mutex m_write_mutex;
+    std::condition_variable m_save_condition;
+    bool m_writer_running = false;
+    bool m_save_pending = false;
+    size_t m_save_requests = 0;
+    std::string m_pending_save;
+    std::chrono::steady_clock::time_point m_first_save_request;
+    std::chrono::steady_clock::time_point m_last_save_request;
+    // Last content written, guarded by m_write_mutex
+    std::string m_saved;
 };
@@ -0,0 +1,44 @@
+#include "StartupTrace.hpp"
+#include <borealis.hpp>
+
+StartupTrace::StartupTrace() : m_start(Clock::now()), m_last(m_start) {}
+
+void StartupTrace::mark(const std::string& phase) {
+    if (m_has_first_frame)
+        return;
+
+    auto now = Clock::now();
+    m_phases.emplace_back(
+        phase, std::chrono::duration_cast<std::chrono::microseconds>(now - m_last));
+    m_last = now;
+}
+
+void StartupTrace::first_frame() {
+    if (m_has_first_frame)
+        return;
+
+    mark("first frame");
+    m_has_first_frame = true;
+    auto timeToFirstFrame =
+        std::chrono::duration_cast<std::chrono::milliseconds>(m_last - m_start);
+
+    for (const auto& [phase, duration] : m_phases) {
+        brls::Logger::info("StartupTrace: {} took {:.1f} ms", phase,
+                           duration.count() / 1000.0);
+    }
+
+    // Keep this line stable, it is what startup regressions are checked
+    // against
+    brls::Logger::info("StartupTrace: Time to first frame {} ms",
+                       timeToFirstFrame.count());
+}
+
+void StartupTrace::deferred(const std::string& phase,
+                            const std::function<void()>& work) {
+    auto start = Clock::now();
+    work();
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(
+        Clock::now() - start);
+    brls::Logger::info("StartupTrace: {} took {:.1f} ms after first frame",
+                       phase, duration.count() / 1000.0);
+}
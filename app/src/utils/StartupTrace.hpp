@@ -0,0 +1,33 @@
+#pragma once
+
+#include "Singleton.hpp"
+#include <chrono>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Times the phases of startup. Every mark() closes the phase that ran since
+// the previous one; first_frame() closes the last one and logs them all
+// together with the time to first frame.
+class StartupTrace : public Singleton<StartupTrace> {
+  public:
+    StartupTrace();
+
+    void mark(const std::string& phase);
+    void first_frame();
+
+    // Runs work that was moved behind the first frame and logs its duration
+    // on its own, it is not part of the time to first frame
+    void deferred(const std::string& phase, const std::function<void()>& work);
+
+    [[nodiscard]] bool has_first_frame() const { return m_has_first_frame; }
+
+  private:
+    using Clock = std::chrono::steady_clock;
+
+    Clock::time_point m_start;
+    Clock::time_point m_last;
+    std::vector<std::pair<std::string, std::chrono::microseconds>> m_phases;
+    bool m_has_first_frame = false;
+};
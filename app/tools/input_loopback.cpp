@@ -0,0 +1,205 @@
+//
+//  input_loopback.cpp
+//  Moonlight
+//
+//  Drives scripted controller, mouse and keyboard sequences through
+//  MoonlightInputManager into fake LiSend* calls, then checks what was sent,
+//  in which order, and that no input took longer than latency_bound to go
+//  out. Needs no controller and no window. Exits with 1 on a failure.
+//
+
+#include "InputManager.hpp"
+#include "Limelight.h"
+#include "Settings.hpp"
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace brls;
+
+// The sink returns at once, anything slower is the manager's own time
+static const double latency_bound_us = 20000;
+
+struct SentEvent {
+    std::string call;
+    int a = 0;
+    int b = 0;
+};
+
+static std::vector<SentEvent> sent;
+
+// Stand-ins for moonlight-common-c, which is not linked into this test
+int LiSendMultiControllerEvent(short controllerNumber, short activeGamepadMask,
+                               int buttonFlags, unsigned char leftTrigger,
+                               unsigned char rightTrigger, short leftStickX,
+                               short leftStickY, short rightStickX,
+                               short rightStickY) {
+    sent.push_back({"controller", controllerNumber, buttonFlags});
+    return 0;
+}
+
+int LiSendControllerArrivalEvent(uint8_t controllerNumber,
+                                 uint16_t activeGamepadMask, uint8_t type,
+                                 uint32_t supportedButtonFlags,
+                                 uint16_t capabilities) {
+    sent.push_back({"arrival", controllerNumber, 0});
+    return 0;
+}
+
+int LiSendKeyboardEvent(short keyCode, char keyAction, char modifiers) {
+    sent.push_back({"keyboard", keyCode, keyAction});
+    return 0;
+}
+
+int LiSendMouseMoveEvent(short deltaX, short deltaY) {
+    sent.push_back({"mouse_move", deltaX, deltaY});
+    return 0;
+}
+
+int LiSendMousePositionEvent(short x, short y, short referenceWidth,
+                             short referenceHeight) {
+    sent.push_back({"mouse_position", x, y});
+    return 0;
+}
+
+int LiSendMouseButtonEvent(char action, int button) {
+    sent.push_back({"mouse_button", action, button});
+    return 0;
+}
+
+int LiSendScrollEvent(signed char scrollClicks) {
+    sent.push_back({"scroll", scrollClicks, 0});
+    return 0;
+}
+
+int LiSendTouchEvent(uint8_t eventType, uint32_t pointerId, float x, float y,
+                     float pressureOrDistance, float contactAreaMajor,
+                     float contactAreaMinor, uint16_t rotation) {
+    sent.push_back({"touch", eventType, (int)pointerId});
+    return 0;
+}
+
+int LiSendControllerMotionEvent(uint8_t controllerNumber, uint8_t motionType,
+                                float x, float y, float z) {
+    sent.push_back({"motion", controllerNumber, motionType});
+    return 0;
+}
+
+// One controller and a mouse whose state the script sets between frames
+class ScriptedInputSource : public InputSource {
+  public:
+    ControllerState controller{};
+    RawMouseState mouse{};
+
+    int controllersConnected() override { return 1; }
+
+    void controllerState(ControllerState* state, int index) override {
+        *state = controller;
+    }
+
+    void unifiedControllerState(ControllerState* state) override {
+        *state = controller;
+    }
+
+    void mouseState(RawMouseState* state) override { *state = mouse; }
+
+    void rawTouchStates(std::vector<RawTouchState>* states) override {}
+
+    std::vector<TouchState> streamTouches() override { return {}; }
+};
+
+static int failures = 0;
+
+static void expect(const char* step, bool condition) {
+    if (!condition) {
+        printf("%s: unexpected events:", step);
+        for (const SentEvent& event : sent)
+            printf(" %s(%d, %d)", event.call.c_str(), event.a, event.b);
+        printf("\n");
+        failures++;
+    }
+}
+
+static bool sent_is(const std::vector<std::string>& calls) {
+    if (sent.size() != calls.size())
+        return false;
+    for (size_t i = 0; i < calls.size(); i++) {
+        if (sent[i].call != calls[i])
+            return false;
+    }
+    return true;
+}
+
+static void expect_latency(const char* kind, const LatencyHistogram& histogram,
+                           uint64_t count) {
+    printf("%s: %llu sent, p50 %.0f us, max %.1f us\n", kind,
+           (unsigned long long)histogram.total, histogram.percentile(0.5),
+           histogram.max_us);
+
+    if (histogram.total != count) {
+        printf("%s: expected %llu samples\n", kind, (unsigned long long)count);
+        failures++;
+    }
+    if (histogram.max_us > latency_bound_us) {
+        printf("%s: over the %.0f us bound\n", kind, latency_bound_us);
+        failures++;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    // Default settings, kept away from the user's own
+    Settings::instance().set_working_dir(argc > 1 ? argv[1]
+                                                  : "input_loopback_data");
+
+    auto owned = std::make_unique<ScriptedInputSource>();
+    ScriptedInputSource* source = owned.get();
+    MoonlightInputManager manager(std::move(owned));
+    manager.reloadButtonMappingLayout();
+
+    // The first change announces the controller before its state
+    source->controller.buttons[BUTTON_A] = true;
+    manager.handleInput();
+    expect("press", sent_is({"arrival", "controller"}) && sent[1].b != 0);
+    sent.clear();
+
+    // An unchanged frame sends nothing
+    manager.handleInput();
+    expect("hold", sent.empty());
+
+    source->controller.buttons[BUTTON_A] = false;
+    manager.handleInput();
+    expect("release", sent_is({"controller"}) && sent[0].b == 0);
+    sent.clear();
+
+    // Pointer motion goes out before the button change of the same frame
+    manager.addMouseMotion({12, -4});
+    source->mouse.leftButton = true;
+    manager.handleInput();
+    expect("click", sent_is({"mouse_move", "mouse_button"}) &&
+                        sent[0].a > 0 && sent[0].b < 0 &&
+                        sent[1].a == BUTTON_ACTION_PRESS);
+    sent.clear();
+
+    manager.sendKeyboardEvent(0x41, true, 0);
+    expect("key", sent_is({"keyboard"}) && sent[0].a == 0x41 &&
+                      sent[0].b == KEY_ACTION_DOWN);
+    sent.clear();
+
+    // Dropping releases the controller, the mouse and the held key
+    manager.dropInput();
+    expect("drop", sent_is({"controller", "mouse_button", "keyboard"}) &&
+                       sent[0].b == 0 &&
+                       sent[1].a == BUTTON_ACTION_RELEASE &&
+                       sent[2].a == 0x41 && sent[2].b == KEY_ACTION_UP);
+    sent.clear();
+
+    InputPollStats stats = manager.pollStats();
+    expect_latency("gamepad", stats.latency[INPUT_GAMEPAD], 2);
+    expect_latency("keyboard", stats.latency[INPUT_KEYBOARD], 1);
+    expect_latency("mouse button", stats.latency[INPUT_MOUSE_BUTTON], 1);
+    expect_latency("mouse motion", stats.latency[INPUT_MOUSE_MOTION], 1);
+
+    if (failures)
+        printf("%d failures\n", failures);
+    return failures ? 1 : 0;
+}